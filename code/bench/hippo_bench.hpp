@@ -0,0 +1,70 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_BENCH_HPP__
+#define __HIPPO_BENCH_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Helpers shared by the benchmarks, kept out of code/public/inc on purpose
+
+namespace HippoBench {
+
+inline uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// run func(thread_index) on thread_num threads released together, return the elapsed nanoseconds
+inline uint64_t RunThreads(std::size_t thread_num, const std::function<void(std::size_t)> &func) {
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    threads.reserve(thread_num);
+    for (std::size_t i = 0; i < thread_num; ++i) {
+        threads.emplace_back([&go, &func, i] {
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            func(i);
+        });
+    }
+    uint64_t begin = NowNs();
+    go.store(true, std::memory_order_release);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    return NowNs() - begin;
+}
+
+// p in [0, 1], samples are sorted in place
+inline uint64_t Percentile(std::vector<uint64_t> *samples, double p) {
+    if (samples->empty()) {
+        return 0;
+    }
+    std::sort(samples->begin(), samples->end());
+    std::size_t index = static_cast<std::size_t>(p * (samples->size() - 1));
+    return (*samples)[index];
+}
+
+inline double MopsPerSec(uint64_t ops, uint64_t ns) { return ns == 0 ? 0.0 : ops * 1e3 / ns; }
+
+// argv[index] as a number, or fallback when absent
+inline uint64_t Arg(int argc, char **argv, int index, uint64_t fallback) {
+    return argc > index ? std::strtoull(argv[index], nullptr, 10) : fallback;
+}
+
+}  // namespace HippoBench
+
+#endif  // !__HIPPO_BENCH_HPP__
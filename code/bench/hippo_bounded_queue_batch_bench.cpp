@@ -0,0 +1,80 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// BoundedQueue Enqueue/Dequeue one by one vs EnqueueBulk/DequeueBulk, at batch sizes 1/8/64/512.
+// Producers send bursts of a batch, with BlockWaitStrategy every Enqueue notifies, a bulk
+// call notifies once.
+// usage: hippo_bounded_queue_batch_bench [elements] [producers] [consumers]
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "hippo_bench.hpp"
+#include "hippo_bounded_queue.hpp"
+
+using Hippo::Common::BlockWaitStrategy;
+using Hippo::Common::BoundedQueue;
+
+static const uint64_t QUEUE_SIZE = 4096;
+static const uint64_t BATCH_SIZES[] = {1, 8, 64, 512};
+
+static double Run(bool bulk, uint64_t batch, uint64_t element_num, std::size_t producer_num,
+                  std::size_t consumer_num) {
+    BoundedQueue<uint64_t> queue;
+    queue.Init(QUEUE_SIZE, new BlockWaitStrategy());
+    const uint64_t per_producer = element_num / producer_num / batch * batch;
+    const uint64_t total = per_producer * producer_num;
+    std::atomic<uint64_t> consumed(0);
+    uint64_t ns = HippoBench::RunThreads(producer_num + consumer_num, [&](std::size_t index) {
+        std::vector<uint64_t> buffer(batch, index);
+        if (index < producer_num) {
+            for (uint64_t sent = 0; sent < per_producer; sent += batch) {
+                if (bulk) {
+                    uint64_t num = 0;
+                    while (num < batch) {
+                        uint64_t enqueued = queue.EnqueueBulk(buffer.begin() + num, buffer.end());
+                        if (enqueued == 0) {
+                            std::this_thread::yield();
+                        }
+                        num += enqueued;
+                    }
+                    continue;
+                }
+                for (uint64_t i = 0; i < batch; ++i) {
+                    while (!queue.Enqueue(buffer[i])) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+            return;
+        }
+        while (consumed.load(std::memory_order_relaxed) < total) {
+            uint64_t num = bulk ? queue.DequeueBulk(buffer.data(), batch) : queue.Dequeue(buffer.data()) ? 1 : 0;
+            if (num == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            consumed.fetch_add(num, std::memory_order_relaxed);
+        }
+    });
+    return HippoBench::MopsPerSec(total, ns);
+}
+
+int main(int argc, char **argv) {
+    const uint64_t element_num = HippoBench::Arg(argc, argv, 1, 4000000);
+    const std::size_t producer_num = HippoBench::Arg(argc, argv, 2, 1);
+    const std::size_t consumer_num = HippoBench::Arg(argc, argv, 3, 1);
+    printf("%zu producers, %zu consumers\n", producer_num, consumer_num);
+    printf("%-6s %14s %14s %8s\n", "batch", "single Mops/s", "bulk Mops/s", "gain");
+    for (uint64_t batch : BATCH_SIZES) {
+        double single = Run(false, batch, element_num, producer_num, consumer_num);
+        double bulk = Run(true, batch, element_num, producer_num, consumer_num);
+        printf("%-6lu %14.2f %14.2f %7.2fx\n", batch, single, bulk, single == 0 ? 0.0 : bulk / single);
+    }
+    return 0;
+}
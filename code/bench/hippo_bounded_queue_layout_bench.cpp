@@ -0,0 +1,97 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// BoundedQueue slot layouts: ModuloIndexer (size as requested, index by division) vs
+// MaskIndexer (power of two, index by mask), packed or interleaved over cache lines, with
+// the slot number decided at runtime or at compile time.
+//   round trip: one thread enqueues and dequeues, shows the cost of the index computation
+//   mpmc:       producers and consumers on the same queue, shows false sharing
+// usage: hippo_bounded_queue_layout_bench [elements] [producers] [consumers]
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include "hippo_bench.hpp"
+#include "hippo_bounded_queue.hpp"
+
+using Hippo::Common::BoundedQueue;
+using Hippo::Common::BusySpinWaitStrategy;
+using Hippo::Common::MaskIndexer;
+using Hippo::Common::ModuloIndexer;
+
+// not a power of two, so the modulo layout keeps an arbitrary size
+static const uint64_t QUEUE_SIZE = 1000;
+static const uint64_t MASK_SIZE = 1024;
+
+template <typename Indexer>
+static double RoundTrip(uint64_t element_num) {
+    BoundedQueue<uint64_t, Indexer> queue;
+    queue.Init(QUEUE_SIZE, new BusySpinWaitStrategy());
+    uint64_t sum = 0;
+    uint64_t begin = HippoBench::NowNs();
+    for (uint64_t i = 0; i < element_num; i += 64) {
+        for (uint64_t j = 0; j < 64; ++j) {
+            queue.Enqueue(i + j);
+        }
+        uint64_t value = 0;
+        while (queue.Dequeue(&value)) {
+            sum += value;
+        }
+    }
+    uint64_t ns = HippoBench::NowNs() - begin;
+    if (sum == 0) {
+        printf("unexpected empty run\n");
+    }
+    return HippoBench::MopsPerSec(element_num, ns);
+}
+
+template <typename Indexer>
+static double Mpmc(uint64_t element_num, std::size_t producer_num, std::size_t consumer_num) {
+    BoundedQueue<uint64_t, Indexer> queue;
+    queue.Init(QUEUE_SIZE, new BusySpinWaitStrategy());
+    const uint64_t per_producer = element_num / producer_num;
+    const uint64_t total = per_producer * producer_num;
+    std::atomic<uint64_t> consumed(0);
+    uint64_t ns = HippoBench::RunThreads(producer_num + consumer_num, [&](std::size_t index) {
+        if (index < producer_num) {
+            for (uint64_t i = 0; i < per_producer; ++i) {
+                while (!queue.Enqueue(i)) {
+                    std::this_thread::yield();
+                }
+            }
+            return;
+        }
+        uint64_t value = 0;
+        while (consumed.load(std::memory_order_relaxed) < total) {
+            if (queue.Dequeue(&value)) {
+                consumed.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    return HippoBench::MopsPerSec(total, ns);
+}
+
+template <typename Indexer>
+static void Report(const char *name, uint64_t element_num, std::size_t producer_num, std::size_t consumer_num) {
+    printf("%-26s %14.2f %14.2f\n", name, RoundTrip<Indexer>(element_num),
+           Mpmc<Indexer>(element_num, producer_num, consumer_num));
+}
+
+int main(int argc, char **argv) {
+    const uint64_t element_num = HippoBench::Arg(argc, argv, 1, 4000000);
+    const std::size_t producer_num = HippoBench::Arg(argc, argv, 2, 2);
+    const std::size_t consumer_num = HippoBench::Arg(argc, argv, 3, 2);
+    printf("%zu producers, %zu consumers\n", producer_num, consumer_num);
+    printf("%-26s %14s %14s\n", "layout", "trip Mops/s", "mpmc Mops/s");
+    Report<ModuloIndexer>("modulo", element_num, producer_num, consumer_num);
+    Report<MaskIndexer<0, false>>("mask packed", element_num, producer_num, consumer_num);
+    Report<MaskIndexer<0, true>>("mask interleaved", element_num, producer_num, consumer_num);
+    Report<MaskIndexer<MASK_SIZE, true>>("mask interleaved static", element_num, producer_num, consumer_num);
+    return 0;
+}
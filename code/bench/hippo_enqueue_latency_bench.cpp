@@ -0,0 +1,127 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// Enqueue latency percentiles with more producer threads than cores. A producer preempted
+// in the middle of an Enqueue must not stall the others, so p99/p999 should stay close to
+// the median. Only successful calls are timed, a full queue measures the consumer instead.
+//   bounded:  BoundedQueue, per slot sequence numbers
+//   mutex:    ThreadSafeQueue, for reference
+//   pool:     ThreadPool::Post, slot acquire plus task queue enqueue
+// usage: hippo_enqueue_latency_bench [enqueues per producer] [producers per core]
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hippo_bench.hpp"
+#include "hippo_bounded_queue.hpp"
+#include "hippo_thread_pool.hpp"
+#include "hippo_thread_safe_queue.hpp"
+
+using Hippo::Common::BoundedQueue;
+using Hippo::Common::BusySpinWaitStrategy;
+using Hippo::Common::ThreadPool;
+using Hippo::Common::ThreadSafeQueue;
+
+static const uint64_t QUEUE_SIZE = 1 << 16;
+
+// dequeue until the producers are done and the queue is empty
+template <typename Queue>
+static void Drain(Queue *queue, const std::atomic<std::size_t> &running) {
+    uint64_t value = 0;
+    while (true) {
+        if (queue->Dequeue(&value)) {
+            continue;
+        }
+        if (running.load() == 0 && !queue->Dequeue(&value)) {
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+// try_enqueue() returns false when full, consume() runs on the consumer thread until done
+template <typename TryEnqueue, typename Consume>
+static void Measure(const char *name, std::size_t producer_num, uint64_t per_producer, TryEnqueue try_enqueue,
+                    Consume consume) {
+    std::vector<std::vector<uint64_t>> samples(producer_num);
+    std::atomic<std::size_t> running(producer_num);
+    HippoBench::RunThreads(producer_num + 1, [&](std::size_t index) {
+        if (index == producer_num) {
+            consume(running);
+            return;
+        }
+        std::vector<uint64_t> &local = samples[index];
+        local.reserve(per_producer);
+        for (uint64_t i = 0; i < per_producer; ++i) {
+            while (true) {
+                uint64_t begin = HippoBench::NowNs();
+                bool ok = try_enqueue(i);
+                uint64_t end = HippoBench::NowNs();
+                if (ok) {
+                    local.push_back(end - begin);
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+        running.fetch_sub(1);
+    });
+    std::vector<uint64_t> all;
+    for (auto &local : samples) {
+        all.insert(all.end(), local.begin(), local.end());
+    }
+    uint64_t p50 = HippoBench::Percentile(&all, 0.5);
+    uint64_t p99 = HippoBench::Percentile(&all, 0.99);
+    uint64_t p999 = HippoBench::Percentile(&all, 0.999);
+    printf("%-8s %10lu %10lu %10lu %10lu\n", name, p50, p99, p999, all.empty() ? 0 : all.back());
+}
+
+int main(int argc, char **argv) {
+    const uint64_t per_producer = HippoBench::Arg(argc, argv, 1, 200000);
+    const uint64_t per_core = HippoBench::Arg(argc, argv, 2, 4);
+    const std::size_t core_num = std::max(std::thread::hardware_concurrency(), 1U);
+    const std::size_t producer_num = core_num * per_core;
+    printf("%zu cores, %zu producers, 1 consumer, nanoseconds\n", core_num, producer_num);
+    printf("%-8s %10s %10s %10s %10s\n", "queue", "p50", "p99", "p999", "max");
+
+    {
+        BoundedQueue<uint64_t> queue;
+        queue.Init(QUEUE_SIZE, new BusySpinWaitStrategy());
+        Measure(
+            "bounded", producer_num, per_producer, [&queue](uint64_t value) { return queue.Enqueue(value); },
+            [&queue](const std::atomic<std::size_t> &running) { Drain(&queue, running); });
+    }
+    {
+        ThreadSafeQueue<uint64_t> queue;
+        Measure(
+            "mutex", producer_num, per_producer,
+            [&queue](uint64_t value) {
+                queue.Enqueue(value);
+                return true;
+            },
+            [&queue](const std::atomic<std::size_t> &running) { Drain(&queue, running); });
+    }
+    {
+        // tasks which do not fit run on the producer, keep the pool far from saturation
+        std::atomic<uint64_t> done(0);
+        ThreadPool pool(1, QUEUE_SIZE);
+        Measure(
+            "pool", producer_num, per_producer / 4,
+            [&pool, &done](uint64_t) { return pool.TryPost([&done] { done.fetch_add(1); }); },
+            [](const std::atomic<std::size_t> &running) {
+                while (running.load() > 0) {
+                    std::this_thread::yield();
+                }
+            });
+        while (done.load() < producer_num * (per_producer / 4)) {
+            std::this_thread::yield();
+        }
+    }
+    return 0;
+}
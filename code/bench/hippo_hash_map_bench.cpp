@@ -0,0 +1,93 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// FlatAtomicHashMap vs AtomicHashMap, insert and random lookup of uint64_t keys and values.
+// The default sizes are 1K and 1M keys. 100M keys needs about 4GB for the flat map and more
+// than 6GB for the list based map, pass it explicitly on a large enough machine:
+//   hippo_hash_map_bench 1000 1000000 100000000
+// usage: hippo_hash_map_bench [key number...]
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "hippo_bench.hpp"
+#include "hippo_flat_hash_map.hpp"
+#include "hippo_hash_map.hpp"
+
+using Hippo::Common::AtomicHashMap;
+using Hippo::Common::FlatAtomicHashMap;
+
+static const uint64_t LOOKUP_NUM = 4000000;
+
+struct Result {
+    double insert;
+    double lookup;
+};
+
+template <typename Map>
+static Result Run(Map *map, const std::vector<uint64_t> &keys, std::size_t thread_num) {
+    Result result = {0, 0};
+    uint64_t ns = HippoBench::RunThreads(thread_num, [&](std::size_t index) {
+        for (std::size_t i = index; i < keys.size(); i += thread_num) {
+            map->Set(keys[i], keys[i]);
+        }
+    });
+    result.insert = HippoBench::MopsPerSec(keys.size(), ns);
+
+    std::atomic<uint64_t> found(0);
+    ns = HippoBench::RunThreads(thread_num, [&](std::size_t index) {
+        std::mt19937_64 random(index);
+        uint64_t local_found = 0;
+        uint64_t value = 0;
+        for (uint64_t i = 0; i < LOOKUP_NUM / thread_num; ++i) {
+            local_found += map->Get(keys[random() % keys.size()], &value) ? 1 : 0;
+        }
+        found.fetch_add(local_found);
+    });
+    if (found.load() != LOOKUP_NUM / thread_num * thread_num) {
+        printf("missing keys\n");
+    }
+    result.lookup = HippoBench::MopsPerSec(LOOKUP_NUM / thread_num * thread_num, ns);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    std::vector<uint64_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        sizes.push_back(HippoBench::Arg(argc, argv, i, 0));
+    }
+    if (sizes.empty()) {
+        sizes = {1000, 1000000};
+    }
+    const std::size_t thread_num = std::max(std::thread::hardware_concurrency(), 1U);
+    printf("%zu threads, Mops/s\n", thread_num);
+    printf("%-12s %12s %12s %12s %12s\n", "keys", "list insert", "list lookup", "flat insert", "flat lookup");
+    for (uint64_t size : sizes) {
+        std::vector<uint64_t> keys(size);
+        std::mt19937_64 random(size);
+        for (uint64_t &key : keys) {
+            key = random();
+        }
+        Result list = {0, 0};
+        {
+            std::unique_ptr<AtomicHashMap<uint64_t, uint64_t>> map(new AtomicHashMap<uint64_t, uint64_t>());
+            list = Run(map.get(), keys, thread_num);
+        }
+        Result flat = {0, 0};
+        {
+            // load factor 0.5
+            std::unique_ptr<FlatAtomicHashMap<uint64_t, uint64_t>> map(
+                new FlatAtomicHashMap<uint64_t, uint64_t>(size * 2));
+            flat = Run(map.get(), keys, thread_num);
+        }
+        printf("%-12lu %12.2f %12.2f %12.2f %12.2f\n", size, list.insert, list.lookup, flat.insert, flat.lookup);
+    }
+    return 0;
+}
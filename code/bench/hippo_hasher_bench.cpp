@@ -0,0 +1,108 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// Bucket distribution and AtomicHashMap lookup speed of the identity std::hash, which the
+// map used to index with directly, vs DefaultHasher, for sequential, strided, random and
+// string keys. Buckets are taken from the low bits of the hash like AtomicHashMap does.
+// usage: hippo_hasher_bench [keys] [lookups]
+
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "hippo_bench.hpp"
+#include "hippo_hash.hpp"
+#include "hippo_hash_map.hpp"
+
+using Hippo::Common::AtomicHashMap;
+using Hippo::Common::DefaultHasher;
+
+static const uint64_t STRIDE = 1024;
+
+template <typename K>
+struct IdentityHasher {
+    uint64_t operator()(const K &key) const { return static_cast<uint64_t>(std::hash<K>()(key)); }
+};
+
+// share of the buckets holding a key and the largest bucket, with keys / 2 buckets
+template <typename Hasher, typename K>
+static void Distribution(const std::vector<K> &keys, double *used, uint64_t *largest) {
+    uint64_t bucket_num = 1;
+    while (bucket_num * 2 < keys.size()) {
+        bucket_num <<= 1;
+    }
+    std::vector<uint64_t> buckets(bucket_num, 0);
+    Hasher hasher;
+    for (const K &key : keys) {
+        ++buckets[hasher(key) & (bucket_num - 1)];
+    }
+    uint64_t used_num = 0;
+    *largest = 0;
+    for (uint64_t count : buckets) {
+        used_num += count > 0 ? 1 : 0;
+        *largest = std::max(*largest, count);
+    }
+    *used = 100.0 * used_num / bucket_num;
+}
+
+template <typename Hasher, typename K>
+static double Lookup(const std::vector<K> &keys, uint64_t lookup_num) {
+    AtomicHashMap<K, uint64_t, 128, Hasher> map;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        map.Set(keys[i], i);
+    }
+    std::mt19937_64 random(lookup_num);
+    uint64_t found = 0;
+    uint64_t value = 0;
+    uint64_t begin = HippoBench::NowNs();
+    for (uint64_t i = 0; i < lookup_num; ++i) {
+        found += map.Get(keys[random() % keys.size()], &value) ? 1 : 0;
+    }
+    uint64_t ns = HippoBench::NowNs() - begin;
+    if (found != lookup_num) {
+        printf("missing keys\n");
+    }
+    return HippoBench::MopsPerSec(lookup_num, ns);
+}
+
+template <typename K>
+static void Report(const char *name, const std::vector<K> &keys, uint64_t lookup_num) {
+    double identity_used = 0;
+    double mixed_used = 0;
+    uint64_t identity_largest = 0;
+    uint64_t mixed_largest = 0;
+    Distribution<IdentityHasher<K>>(keys, &identity_used, &identity_largest);
+    Distribution<DefaultHasher<K>>(keys, &mixed_used, &mixed_largest);
+    printf("%-11s %8.1f%% %9lu %10.2f   %8.1f%% %9lu %10.2f\n", name, identity_used, identity_largest,
+           Lookup<IdentityHasher<K>>(keys, lookup_num), mixed_used, mixed_largest,
+           Lookup<DefaultHasher<K>>(keys, lookup_num));
+}
+
+int main(int argc, char **argv) {
+    const uint64_t key_num = HippoBench::Arg(argc, argv, 1, 100000);
+    const uint64_t lookup_num = HippoBench::Arg(argc, argv, 2, 200000);
+    std::vector<uint64_t> sequential(key_num);
+    std::vector<uint64_t> strided(key_num);
+    std::vector<uint64_t> random_keys(key_num);
+    std::vector<std::string> strings(key_num);
+    std::mt19937_64 random(key_num);
+    for (uint64_t i = 0; i < key_num; ++i) {
+        sequential[i] = i;
+        strided[i] = i * STRIDE;
+        random_keys[i] = random();
+        strings[i] = "user_" + std::to_string(i);
+    }
+    printf("%lu keys, %lu lookups, lookup in Mops/s\n", key_num, lookup_num);
+    printf("%-11s %9s %9s %10s   %9s %9s %10s\n", "keys", "id used", "id max", "id lookup", "mix used", "mix max",
+           "mix lookup");
+    Report("sequential", sequential, lookup_num);
+    Report("strided", strided, lookup_num);
+    Report("random", random_keys, lookup_num);
+    Report("string", strings, lookup_num);
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// ObjectPool vs new/delete vs a plain free list like the former single threaded pool,
+// which is only measured where it is safe, on one thread.
+//   single: one thread acquires and releases, WINDOW objects alive at a time
+//   local:  every thread acquires and releases its own objects
+//   cross:  producers acquire, consumers release the objects received through a queue
+// usage: hippo_object_pool_bench [operations] [threads]
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "hippo_bench.hpp"
+#include "hippo_bounded_queue.hpp"
+#include "hippo_object_poll.hpp"
+
+using Hippo::Common::BoundedQueue;
+using Hippo::Common::BusySpinWaitStrategy;
+using Hippo::Common::ObjectPool;
+
+static const std::size_t WINDOW = 16;
+
+struct Object {
+    uint64_t data[8];
+};
+
+// single threaded intrusive free list
+class FreeList {
+public:
+    explicit FreeList(std::size_t num) : objects_(num) {
+        for (Object &object : objects_) {
+            Release(&object);
+        }
+    }
+    Object *Acquire() {
+        Object *object = head_;
+        if (object != nullptr) {
+            head_ = *reinterpret_cast<Object **>(object);
+        }
+        return object;
+    }
+    void Release(Object *object) {
+        *reinterpret_cast<Object **>(object) = head_;
+        head_ = object;
+    }
+
+private:
+    std::vector<Object> objects_;
+    Object *head_ = nullptr;
+};
+
+// acquire() and release(object) for one allocation scheme
+struct NewDelete {
+    Object *Acquire() { return new Object(); }
+    void Release(Object *object) { delete object; }
+};
+
+struct Pool {
+    explicit Pool(uint32_t num) : pool(std::make_shared<ObjectPool<Object>>(num)) {}
+    Object *Acquire() { return pool->GetUnique().release(); }
+    void Release(Object *object) { ObjectPool<Object>::Deleter{pool.get()}(object); }
+    std::shared_ptr<ObjectPool<Object>> pool;
+};
+
+template <typename Allocator>
+static void Churn(Allocator *allocator, uint64_t op_num) {
+    Object *window[WINDOW] = {nullptr};
+    for (uint64_t i = 0; i < op_num; ++i) {
+        Object *&slot = window[i % WINDOW];
+        if (slot != nullptr) {
+            allocator->Release(slot);
+        }
+        slot = allocator->Acquire();
+        slot->data[0] = i;
+    }
+    for (Object *object : window) {
+        if (object != nullptr) {
+            allocator->Release(object);
+        }
+    }
+}
+
+template <typename Allocator>
+static double Local(Allocator *allocator, uint64_t op_num, std::size_t thread_num) {
+    uint64_t ns = HippoBench::RunThreads(thread_num, [&](std::size_t) { Churn(allocator, op_num / thread_num); });
+    return HippoBench::MopsPerSec(op_num / thread_num * thread_num, ns);
+}
+
+template <typename Allocator>
+static double Cross(Allocator *allocator, uint64_t op_num, std::size_t pair_num) {
+    BoundedQueue<Object *> queue;
+    queue.Init(1024, new BusySpinWaitStrategy());
+    const uint64_t per_producer = op_num / pair_num;
+    std::atomic<uint64_t> released(0);
+    uint64_t ns = HippoBench::RunThreads(pair_num * 2, [&](std::size_t index) {
+        if (index < pair_num) {
+            for (uint64_t i = 0; i < per_producer; ++i) {
+                Object *object = allocator->Acquire();
+                while (object == nullptr) {
+                    // every object is in flight
+                    std::this_thread::yield();
+                    object = allocator->Acquire();
+                }
+                while (!queue.Enqueue(object)) {
+                    std::this_thread::yield();
+                }
+            }
+            return;
+        }
+        Object *object = nullptr;
+        while (released.load(std::memory_order_relaxed) < per_producer * pair_num) {
+            if (queue.Dequeue(&object)) {
+                allocator->Release(object);
+                released.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    return HippoBench::MopsPerSec(per_producer * pair_num, ns);
+}
+
+int main(int argc, char **argv) {
+    const uint64_t op_num = HippoBench::Arg(argc, argv, 1, 10000000);
+    const std::size_t thread_num = HippoBench::Arg(argc, argv, 2, std::max(std::thread::hardware_concurrency(), 2U));
+    // enough for the windows and the queue of every thread
+    const uint32_t object_num = static_cast<uint32_t>(thread_num * (WINDOW + 1024) * 2);
+    printf("%zu threads, acquire + release Mops/s\n", thread_num);
+    printf("%-10s %12s %12s %12s\n", "scheme", "single", "local", "cross");
+    {
+        FreeList free_list(WINDOW);
+        printf("%-10s %12.2f %12s %12s\n", "free list", Local(&free_list, op_num, 1), "-", "-");
+    }
+    {
+        NewDelete new_delete;
+        printf("%-10s %12.2f %12.2f %12.2f\n", "new", Local(&new_delete, op_num, 1),
+               Local(&new_delete, op_num, thread_num), Cross(&new_delete, op_num, thread_num / 2));
+    }
+    {
+        Pool pool(object_num);
+        printf("%-10s %12.2f %12.2f %12.2f\n", "pool", Local(&pool, op_num, 1), Local(&pool, op_num, thread_num),
+               Cross(&pool, op_num, thread_num / 2));
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// Read throughput of the RW locks from 1 to 64 reader threads, with no writer and with
+// one writer taking the lock every WRITE_INTERVAL_US microseconds. On AtomicRWLock every
+// reader updates the same word, ReaderBiasedRWLock readers mark their own cache line.
+// usage: hippo_rw_lock_bench [read locks] [max threads]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "hippo_bench.hpp"
+#include "hippo_lock_guard.hpp"
+#include "hippo_rw_lock.hpp"
+
+using Hippo::Common::AtomicRWLock;
+using Hippo::Common::ParkingRWLock;
+using Hippo::Common::ReaderBiasedRWLock;
+using Hippo::Common::ReadLockGuard;
+using Hippo::Common::WriteLockGuard;
+
+static const uint64_t WRITE_INTERVAL_US = 100;
+
+template <typename Lock>
+static double Read(std::size_t reader_num, uint64_t read_num, bool with_writer) {
+    Lock lock;
+    uint64_t data = 0;
+    std::atomic<std::size_t> running(reader_num);
+    const uint64_t per_reader = read_num / reader_num;
+    uint64_t ns = HippoBench::RunThreads(reader_num + (with_writer ? 1 : 0), [&](std::size_t index) {
+        if (index == reader_num) {
+            while (running.load(std::memory_order_relaxed) > 0) {
+                {
+                    WriteLockGuard<Lock> guard(lock);
+                    ++data;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(WRITE_INTERVAL_US));
+            }
+            return;
+        }
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < per_reader; ++i) {
+            ReadLockGuard<Lock> guard(lock);
+            sum += data;
+        }
+        if (sum == UINT64_MAX) {
+            printf("unreachable\n");
+        }
+        running.fetch_sub(1, std::memory_order_relaxed);
+    });
+    return HippoBench::MopsPerSec(per_reader * reader_num, ns);
+}
+
+int main(int argc, char **argv) {
+    const uint64_t read_num = HippoBench::Arg(argc, argv, 1, 4000000);
+    const uint64_t max_threads = HippoBench::Arg(argc, argv, 2, 64);
+    printf("read locks Mops/s\n");
+    printf("%-8s %-7s %12s %12s %12s\n", "readers", "writer", "atomic", "biased", "parking");
+    for (bool with_writer : {false, true}) {
+        for (uint64_t threads = 1; threads <= max_threads; threads *= 2) {
+            double atomic = Read<AtomicRWLock>(threads, read_num, with_writer);
+            double biased = Read<ReaderBiasedRWLock<>>(threads, read_num, with_writer);
+            double parking = Read<ParkingRWLock>(threads, read_num, with_writer);
+            printf("%-8lu %-7s %12.2f %12.2f %12.2f\n", threads, with_writer ? "yes" : "no", atomic, biased, parking);
+        }
+    }
+    return 0;
+}
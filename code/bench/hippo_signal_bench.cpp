@@ -0,0 +1,92 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// Emit cost of Signal against slot count and emitter thread count. The reference is the
+// former emission path: lock, copy the slot list (one node and one shared_ptr increment
+// per slot), call the slots, lock again to drop disconnected slots.
+// usage: hippo_signal_bench [emits] [max threads]
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "hippo_bench.hpp"
+#include "hippo_signal.hpp"
+
+using Hippo::Common::Signal;
+
+static const int SLOT_NUMS[] = {1, 8, 64};
+
+template <typename... Args>
+class LockedSignal {
+public:
+    using Callback = std::function<void(Args...)>;
+    using SlotPtr = std::shared_ptr<Callback>;
+
+    void operator()(Args... args) {
+        std::list<SlotPtr> local;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto &slot : slots_) {
+                local.emplace_back(slot);
+            }
+        }
+        for (auto &slot : local) {
+            (*slot)(args...);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_.remove_if([](const SlotPtr &slot) { return slot == nullptr; });
+    }
+
+    void Connect(const Callback &cb) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_.emplace_back(std::make_shared<Callback>(cb));
+    }
+
+private:
+    std::list<SlotPtr> slots_;
+    std::mutex mutex_;
+};
+
+// nanoseconds per emission
+template <typename SignalType>
+static double Emit(int slot_num, std::size_t thread_num, uint64_t emit_num) {
+    SignalType signal;
+    std::atomic<uint64_t> sum(0);
+    for (int i = 0; i < slot_num; ++i) {
+        signal.Connect([&sum](int value) { sum.fetch_add(value, std::memory_order_relaxed); });
+    }
+    const uint64_t per_thread = emit_num / thread_num;
+    uint64_t ns = HippoBench::RunThreads(thread_num, [&](std::size_t) {
+        for (uint64_t i = 0; i < per_thread; ++i) {
+            signal(1);
+        }
+    });
+    if (sum.load() != per_thread * thread_num * slot_num) {
+        printf("lost calls\n");
+    }
+    return static_cast<double>(ns) / (per_thread * thread_num);
+}
+
+int main(int argc, char **argv) {
+    const uint64_t emit_num = HippoBench::Arg(argc, argv, 1, 200000);
+    const uint64_t max_threads = HippoBench::Arg(argc, argv, 2, std::max(std::thread::hardware_concurrency(), 4U));
+    printf("ns per emission\n");
+    printf("%-6s %-8s %12s %12s\n", "slots", "threads", "locked", "signal");
+    for (int slot_num : SLOT_NUMS) {
+        for (uint64_t threads = 1; threads <= max_threads; threads *= 2) {
+            double locked = Emit<LockedSignal<int>>(slot_num, threads, emit_num);
+            double lock_free = Emit<Signal<int>>(slot_num, threads, emit_num);
+            printf("%-6d %-8lu %12.1f %12.1f\n", slot_num, threads, locked, lock_free);
+        }
+    }
+    return 0;
+}
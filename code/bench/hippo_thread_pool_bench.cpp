@@ -0,0 +1,89 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// Single queue ThreadPool vs WorkStealingThreadPool
+//   external: tasks posted from outside threads, every task goes through the shared queue
+//   fork:     every task posted from outside forks children from the worker, which stay on
+//             the worker's own deque with WorkStealingThreadPool
+// usage: hippo_thread_pool_bench [tasks] [max threads]
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include "hippo_bench.hpp"
+#include "hippo_thread_pool.hpp"
+
+using Hippo::Common::ThreadPool;
+using Hippo::Common::WorkStealingThreadPool;
+
+static const std::size_t FORK_NUM = 16;
+static const std::size_t SLOT_NUM = 4096;
+// keep in flight tasks below the slot number, a saturated pool runs tasks on the caller
+static const uint64_t MAX_IN_FLIGHT = SLOT_NUM / 2;
+
+static void WaitInFlight(const std::atomic<uint64_t> &done, uint64_t posted) {
+    while (posted - done.load(std::memory_order_relaxed) > MAX_IN_FLIGHT) {
+        std::this_thread::yield();
+    }
+}
+
+template <typename Pool>
+static double External(std::size_t thread_num, uint64_t task_num) {
+    std::atomic<uint64_t> done(0);
+    uint64_t ns = 0;
+    {
+        Pool pool(thread_num, SLOT_NUM);
+        ns = HippoBench::RunThreads(1, [&](std::size_t) {
+            for (uint64_t i = 0; i < task_num; ++i) {
+                WaitInFlight(done, i);
+                pool.Post([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+            }
+            while (done.load(std::memory_order_relaxed) < task_num) {
+                std::this_thread::yield();
+            }
+        });
+    }
+    return HippoBench::MopsPerSec(task_num, ns);
+}
+
+template <typename Pool>
+static double Fork(std::size_t thread_num, uint64_t task_num) {
+    std::atomic<uint64_t> done(0);
+    const uint64_t root_num = task_num / (FORK_NUM + 1);
+    uint64_t ns = 0;
+    {
+        Pool pool(thread_num, SLOT_NUM);
+        ns = HippoBench::RunThreads(1, [&](std::size_t) {
+            for (uint64_t i = 0; i < root_num; ++i) {
+                WaitInFlight(done, i * (FORK_NUM + 1));
+                pool.Post([&pool, &done] {
+                    for (std::size_t j = 0; j < FORK_NUM; ++j) {
+                        pool.Post([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+                    }
+                    done.fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+            while (done.load(std::memory_order_relaxed) < root_num * (FORK_NUM + 1)) {
+                std::this_thread::yield();
+            }
+        });
+    }
+    return HippoBench::MopsPerSec(root_num * (FORK_NUM + 1), ns);
+}
+
+int main(int argc, char **argv) {
+    const uint64_t task_num = HippoBench::Arg(argc, argv, 1, 1000000);
+    const uint64_t max_threads = HippoBench::Arg(argc, argv, 2, std::max(std::thread::hardware_concurrency(), 1U));
+    printf("%-8s %-10s %14s %14s\n", "threads", "workload", "single Mops/s", "stealing Mops/s");
+    for (uint64_t threads = 1; threads <= max_threads; threads *= 2) {
+        printf("%-8lu %-10s %14.2f %14.2f\n", threads, "external", External<ThreadPool>(threads, task_num),
+               External<WorkStealingThreadPool>(threads, task_num));
+        printf("%-8lu %-10s %14.2f %14.2f\n", threads, "fork", Fork<ThreadPool>(threads, task_num),
+               Fork<WorkStealingThreadPool>(threads, task_num));
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// Segmented UnboundedQueue vs a queue allocating one node per element. The node queue of
+// the former UnboundedQueue is not safe to run with several threads, the reference here is
+// the two lock queue of Michael and Scott with the same seq_cst size counter.
+//   burst: one thread enqueues every element then dequeues them
+//   mpmc:  producers and consumers on the same queue
+// usage: hippo_unbounded_queue_bench [elements] [producers] [consumers]
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include "hippo_bench.hpp"
+#include "hippo_unbounded_queue.hpp"
+
+using Hippo::Common::UnboundedQueue;
+
+template <typename T>
+class NodeQueue {
+public:
+    NodeQueue() : head_(new Node()), tail_(head_) {}
+    ~NodeQueue() {
+        while (head_ != nullptr) {
+            Node *next = head_->next.load(std::memory_order_relaxed);
+            delete head_;
+            head_ = next;
+        }
+    }
+
+    void Enqueue(const T &element) {
+        Node *node = new Node();
+        node->data = element;
+        {
+            std::lock_guard<std::mutex> lock(tail_mutex_);
+            tail_->next.store(node, std::memory_order_release);
+            tail_ = node;
+        }
+        size_.fetch_add(1);
+    }
+
+    bool Dequeue(T *element) {
+        Node *old_head = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(head_mutex_);
+            Node *next = head_->next.load(std::memory_order_acquire);
+            if (next == nullptr) {
+                return false;
+            }
+            *element = next->data;
+            old_head = head_;
+            head_ = next;
+        }
+        size_.fetch_sub(1);
+        delete old_head;
+        return true;
+    }
+
+private:
+    struct Node {
+        T data = T();
+        std::atomic<Node *> next = {nullptr};
+    };
+
+    Node *head_;
+    Node *tail_;
+    std::mutex head_mutex_;
+    std::mutex tail_mutex_;
+    std::atomic<size_t> size_ = {0};
+};
+
+template <typename Queue>
+static double Burst(uint64_t element_num) {
+    Queue queue;
+    uint64_t sum = 0;
+    uint64_t begin = HippoBench::NowNs();
+    for (uint64_t i = 0; i < element_num; ++i) {
+        queue.Enqueue(i);
+    }
+    uint64_t value = 0;
+    while (queue.Dequeue(&value)) {
+        sum += value;
+    }
+    uint64_t ns = HippoBench::NowNs() - begin;
+    if (sum != element_num * (element_num - 1) / 2) {
+        printf("lost elements\n");
+    }
+    return HippoBench::MopsPerSec(element_num * 2, ns);
+}
+
+template <typename Queue>
+static double Mpmc(uint64_t element_num, std::size_t producer_num, std::size_t consumer_num) {
+    Queue queue;
+    const uint64_t per_producer = element_num / producer_num;
+    const uint64_t total = per_producer * producer_num;
+    std::atomic<uint64_t> consumed(0);
+    uint64_t ns = HippoBench::RunThreads(producer_num + consumer_num, [&](std::size_t index) {
+        if (index < producer_num) {
+            for (uint64_t i = 0; i < per_producer; ++i) {
+                queue.Enqueue(i);
+            }
+            return;
+        }
+        uint64_t value = 0;
+        while (consumed.load(std::memory_order_relaxed) < total) {
+            if (queue.Dequeue(&value)) {
+                consumed.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    return HippoBench::MopsPerSec(total * 2, ns);
+}
+
+int main(int argc, char **argv) {
+    const uint64_t element_num = HippoBench::Arg(argc, argv, 1, 4000000);
+    const std::size_t producer_num = HippoBench::Arg(argc, argv, 2, 2);
+    const std::size_t consumer_num = HippoBench::Arg(argc, argv, 3, 2);
+    printf("%zu producers, %zu consumers, enqueue + dequeue Mops/s\n", producer_num, consumer_num);
+    printf("%-10s %14s %14s\n", "queue", "burst", "mpmc");
+    printf("%-10s %14.2f %14.2f\n", "node", Burst<NodeQueue<uint64_t>>(element_num),
+           Mpmc<NodeQueue<uint64_t>>(element_num, producer_num, consumer_num));
+    printf("%-10s %14.2f %14.2f\n", "segmented", Burst<UnboundedQueue<uint64_t>>(element_num),
+           Mpmc<UnboundedQueue<uint64_t>>(element_num, producer_num, consumer_num));
+    return 0;
+}
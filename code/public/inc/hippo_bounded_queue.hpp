@@ -13,23 +13,122 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdlib>
+#include <iterator>
 #include <memory>
+#include <new>
 #include <utility>
 
 #include "hippo_namespace.hpp"
+#include "hippo_macro.hpp"
 #include "hippo_wati_strategy.hpp"
 
 NAMESPACE_HIPPO_BEGIN
 NAMESPACE_COMMON_BEGIN
 
-template <typename T>
+// Default indexer, keep exactly the requested slots and index by modulo
+class ModuloIndexer {
+public:
+    uint64_t Init(uint64_t slot_num, std::size_t /* element_size */) {
+        slot_num_ = slot_num;
+        return slot_num_;
+    }
+    uint64_t Index(uint64_t num) const {
+        return num - (num / slot_num_) * slot_num_;  // faster than %
+    }
+
+private:
+    uint64_t slot_num_ = 0;
+};
+
+/**
+ * @brief Round slots up to a power of two and index by mask
+ *
+ * When Interleave is true, adjacent logical indices are spread over different cache
+ * lines, so producers/consumers working on neighbouring slots do not false share.
+ *
+ * @tparam StaticSlotNum Slot number fixed at compile time, 0 means decided by Init
+ * @tparam Interleave Whether to spread adjacent slots over cache lines
+ */
+template <uint64_t StaticSlotNum = 0, bool Interleave = true>
+class MaskIndexer {
+    static_assert((StaticSlotNum & (StaticSlotNum - 1)) == 0, "StaticSlotNum must be a power of two");
+
+public:
+    uint64_t Init(uint64_t slot_num, std::size_t element_size) {
+        if (StaticSlotNum != 0) {
+            if (slot_num > StaticSlotNum) {
+                return 0;
+            }
+            slot_num = StaticSlotNum;
+        } else {
+            uint64_t size = 2;
+            while (size < slot_num) {
+                size <<= 1;
+            }
+            slot_num = size;
+        }
+        mask_ = slot_num - 1;
+        // elements per cache line, rounded down to a power of two
+        uint64_t per_line = 1;
+        while (element_size * (per_line << 1) <= CACHELINE_SIZE) {
+            per_line <<= 1;
+        }
+        if (Interleave && per_line > 1 && slot_num > per_line) {
+            line_mask_ = slot_num / per_line - 1;
+            offset_mask_ = per_line - 1;
+            line_bits_ = Log2(slot_num / per_line);
+            offset_bits_ = Log2(per_line);
+        }
+        return slot_num;
+    }
+    uint64_t Index(uint64_t num) const {
+        uint64_t index = num & Mask();
+        if (Interleave) {
+            // logical i lands in line (i % lines), at offset (i / lines)
+            index = ((index & line_mask_) << offset_bits_) | ((index >> line_bits_) & offset_mask_);
+        }
+        return index;
+    }
+
+private:
+    static uint64_t Log2(uint64_t num) {
+        uint64_t bits = 0;
+        while ((1ULL << bits) < num) {
+            ++bits;
+        }
+        return bits;
+    }
+    uint64_t Mask() const { return StaticSlotNum != 0 ? StaticSlotNum - 1 : mask_; }
+
+    uint64_t mask_ = 0;
+    // identity mapping until Init decides to interleave
+    uint64_t line_mask_ = ~0ULL;
+    uint64_t offset_mask_ = 0;
+    uint64_t line_bits_ = 0;
+    uint64_t offset_bits_ = 0;
+};
+
+/**
+ * @brief MPMC bounded queue
+ *
+ * Every slot carries a sequence number (Vyukov's bounded MPMC queue). A slot at
+ * position pos is free when seq == pos and holds data when seq == pos + 1, so each
+ * producer/consumer publishes its own slot and nobody waits on a global commit cursor.
+ *
+ * @tparam T Type of element
+ * @tparam Indexer How slots are counted and indexed, ModuloIndexer or MaskIndexer
+ * @tparam Allocator Allocator of the slot buffer, rebound to cache lines
+ */
+template <typename T, typename Indexer = ModuloIndexer, typename Allocator = std::allocator<T>>
 class BoundedQueue {
 public:
     using value_type = T;
     using size_type = uint64_t;
+    using allocator_type = Allocator;
 
 public:
     BoundedQueue() {}
+    explicit BoundedQueue(const Allocator& allocator) : allocator_(allocator) {}
     BoundedQueue& operator=(const BoundedQueue& other) = delete;
     BoundedQueue(const BoundedQueue& other) = delete;
     ~BoundedQueue() {
@@ -38,62 +137,65 @@ public:
         }
         if (pool_) {
             for (uint64_t i = 0; i < pool_size_; ++i) {
-                pool_[i].~T();
+                pool_[i].~Slot();
             }
-            std::free(pool_);
+            LineTraits::deallocate(allocator_, reinterpret_cast<CacheLine*>(pool_), line_num_);
         }
     }
     bool Init(uint64_t size) { return Init(size, new SleepWaitStrategy()); }
     bool Init(uint64_t size, WaitStrategy* strategy) {
-        // Head and tail each occupy a space
-        pool_size_ = size + 2;
-        pool_ = reinterpret_cast<T*>(std::calloc(pool_size_, sizeof(T)));
-        if (pool_ == nullptr) {
+        pool_size_ = indexer_.Init(std::max<uint64_t>(size, 2), sizeof(Slot));
+        if (pool_size_ == 0) {
+            return false;
+        }
+        // cache line aligned, so the interleaved layout matches real cache lines
+        line_num_ = (pool_size_ * sizeof(Slot) + CACHELINE_SIZE - 1) / CACHELINE_SIZE;
+        try {
+            pool_ = reinterpret_cast<Slot*>(LineTraits::allocate(allocator_, line_num_));
+        } catch (const std::bad_alloc&) {
             return false;
         }
         for (uint64_t i = 0; i < pool_size_; ++i) {
-            new (&(pool_[i])) T();
+            new (&(pool_[GetIndex(i)])) Slot(i);
         }
         wait_strategy_.reset(strategy);
         return true;
     }
-    bool Enqueue(const T& element) {
-        uint64_t new_tail = 0;
-        uint64_t old_commit = 0;
-        uint64_t old_tail = tail_.load(std::memory_order_acquire);
+    bool Enqueue(const T& element) { return EnqueueImpl(element); }
+    bool Enqueue(T&& element) { return EnqueueImpl(std::move(element)); }
+    // Enqueue as many elements of [first, last) as fit with a single claim, return the number enqueued
+    template <typename Iterator>
+    uint64_t EnqueueBulk(Iterator first, Iterator last) {
+        uint64_t count = static_cast<uint64_t>(std::distance(first, last));
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t num = 0;
+        uint64_t pos = tail_.load(std::memory_order_relaxed);
         do {
-            new_tail = old_tail + 1;
-            if (GetIndex(new_tail) == GetIndex(head_.load(std::memory_order_acquire))) {
-                return false;
+            // count the free slots from pos on
+            num = 0;
+            while (num < count && num < pool_size_ &&
+                   pool_[GetIndex(pos + num)].seq.load(std::memory_order_acquire) == pos + num) {
+                ++num;
             }
-        } while (
-            !tail_.compare_exchange_weak(old_tail, new_tail, std::memory_order_acq_rel, std::memory_order_relaxed));
-        pool_[GetIndex(old_tail)] = element;
-        do {
-            old_commit = old_tail;
-        } while (hippo_unlikely(!commit_.compare_exchange_weak(old_commit, new_tail, std::memory_order_acq_rel,
-                                                               std::memory_order_relaxed)));
-        wait_strategy_->NotifyOne();
-        return true;
-    }
-    bool Enqueue(T&& element) {
-        uint64_t new_tail = 0;
-        uint64_t old_commit = 0;
-        uint64_t old_tail = tail_.load(std::memory_order_acquire);
-        do {
-            new_tail = old_tail + 1;
-            if (GetIndex(new_tail) == GetIndex(head_.load(std::memory_order_acquire))) {
-                return false;
+            if (num == 0) {
+                uint64_t tail = tail_.load(std::memory_order_relaxed);
+                if (tail == pos) {
+                    return 0;
+                }
+                pos = tail;
+                continue;
             }
-        } while (
-            !tail_.compare_exchange_weak(old_tail, new_tail, std::memory_order_acq_rel, std::memory_order_relaxed));
-        pool_[GetIndex(old_tail)] = std::move(element);
-        do {
-            old_commit = old_tail;
-        } while (hippo_unlikely(!commit_.compare_exchange_weak(old_commit, new_tail, std::memory_order_acq_rel,
-                                                               std::memory_order_relaxed)));
+        } while (num == 0 ||
+                 !tail_.compare_exchange_weak(pos, pos + num, std::memory_order_relaxed, std::memory_order_relaxed));
+        for (uint64_t i = pos; i != pos + num; ++i, ++first) {
+            Slot& slot = pool_[GetIndex(i)];
+            slot.data = *first;
+            slot.seq.store(i + 1, std::memory_order_release);
+        }
         wait_strategy_->NotifyOne();
-        return true;
+        return num;
     }
     bool WaitEnqueue(const T& element) {
         while (!break_all_wait_) {
@@ -124,24 +226,68 @@ public:
         return false;
     }
     bool Dequeue(T* element) {
-        uint64_t new_head = 0;
-        uint64_t old_head = head_.load(std::memory_order_acquire);
-        do {
-            new_head = old_head + 1;
-            if (new_head == commit_.load(std::memory_order_acquire)) {
+        uint64_t pos = head_.load(std::memory_order_relaxed);
+        Slot* slot = nullptr;
+        while (true) {
+            slot = &pool_[GetIndex(pos)];
+            int64_t diff = static_cast<int64_t>(slot->seq.load(std::memory_order_acquire) - (pos + 1));
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // empty, or the producer of this slot has not published yet
                 return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
             }
-            *element = pool_[GetIndex(new_head)];
-        } while (
-            !head_.compare_exchange_weak(old_head, new_head, std::memory_order_acq_rel, std::memory_order_relaxed));
+        }
+        *element = std::move(slot->data);
+        slot->seq.store(pos + pool_size_, std::memory_order_release);
         return true;
     }
+    // Dequeue up to max_num elements into out with a single claim, return the number dequeued
+    uint64_t DequeueBulk(T* out, uint64_t max_num) {
+        if (max_num == 0) {
+            return 0;
+        }
+        uint64_t num = 0;
+        uint64_t pos = head_.load(std::memory_order_relaxed);
+        do {
+            // count the published slots from pos on
+            num = 0;
+            while (num < max_num && num < pool_size_ &&
+                   pool_[GetIndex(pos + num)].seq.load(std::memory_order_acquire) == pos + num + 1) {
+                ++num;
+            }
+            if (num == 0) {
+                uint64_t head = head_.load(std::memory_order_relaxed);
+                if (head == pos) {
+                    return 0;
+                }
+                pos = head;
+                continue;
+            }
+        } while (num == 0 ||
+                 !head_.compare_exchange_weak(pos, pos + num, std::memory_order_relaxed, std::memory_order_relaxed));
+        for (uint64_t i = pos; i != pos + num; ++i) {
+            Slot& slot = pool_[GetIndex(i)];
+            out[i - pos] = std::move(slot.data);
+            slot.seq.store(i + pool_size_, std::memory_order_release);
+        }
+        return num;
+    }
     bool WaitDequeue(T* element) {
         while (!break_all_wait_) {
             if (Dequeue(element)) {
                 return true;
             }
-            if (wait_strategy_->EmptyWait()) {
+            uint64_t key = wait_strategy_->PrepareWait();
+            if (Dequeue(element)) {
+                wait_strategy_->CancelWait();
+                return true;
+            }
+            if (wait_strategy_->EmptyWait(key)) {
                 continue;
             }
             // wait timeout
@@ -150,28 +296,66 @@ public:
 
         return false;
     }
-    uint64_t Size() { return tail_ - head_ - 1; }
+    uint64_t Size() {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t tail = tail_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
     bool Empty() { return Size() == 0; }
-    void SetWaitStrategy(WaitStrategy* WaitStrategy) { wait_strategy_.reset(strategy); }
+    void SetWaitStrategy(WaitStrategy* strategy) { wait_strategy_.reset(strategy); }
     void BreakAllWait() {
         break_all_wait_ = true;
         wait_strategy_->BreakAllWait();
     }
     uint64_t Head() { return head_.load(); }
     uint64_t Tail() { return tail_.load(); }
-    uint64_t Commit() { return commit_.load(); }
 
 private:
-    uint64_t GetIndex(uint64_t num) {
-        return num - (num / pool_size_) * pool_size_;  // faster than %
+    struct alignas(CACHELINE_SIZE) CacheLine {
+        char bytes[CACHELINE_SIZE];
+    };
+    using LineAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<CacheLine>;
+    using LineTraits = std::allocator_traits<LineAllocator>;
+
+    struct Slot {
+        explicit Slot(uint64_t pos) : seq(pos) {}
+        std::atomic<uint64_t> seq;
+        T data;
+    };
+
+    template <typename U>
+    bool EnqueueImpl(U&& element) {
+        uint64_t pos = tail_.load(std::memory_order_relaxed);
+        Slot* slot = nullptr;
+        while (true) {
+            slot = &pool_[GetIndex(pos)];
+            int64_t diff = static_cast<int64_t>(slot->seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // full, or the consumer of this slot has not released it yet
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->data = std::forward<U>(element);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        wait_strategy_->NotifyOne();
+        return true;
     }
 
+    uint64_t GetIndex(uint64_t num) { return indexer_.Index(num); }
+
     alignas(CACHELINE_SIZE) std::atomic<uint64_t> head_ = {0};
-    alignas(CACHELINE_SIZE) std::atomic<uint64_t> tail_ = {1};
-    alignas(CACHELINE_SIZE) std::atomic<uint64_t> commit_ = {1};
-    // alignas(CACHELINE_SIZE) std::atomic<uint64_t> size_ = {0};
-    uint64_t pool_size_ = 0;
-    T* pool_ = nullptr;
+    alignas(CACHELINE_SIZE) std::atomic<uint64_t> tail_ = {0};
+    alignas(CACHELINE_SIZE) uint64_t pool_size_ = 0;
+    Indexer indexer_;
+    LineAllocator allocator_;
+    uint64_t line_num_ = 0;
+    Slot* pool_ = nullptr;
     std::unique_ptr<WaitStrategy> wait_strategy_ = nullptr;
     volatile bool break_all_wait_ = false;
 };
@@ -0,0 +1,194 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_EPOCH_RECLAIMER_HPP__
+#define __HIPPO_EPOCH_RECLAIMER_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "hippo_namespace.hpp"
+#include "hippo_macro.hpp"
+
+NAMESPACE_HIPPO_BEGIN
+NAMESPACE_COMMON_BEGIN
+
+/**
+ * @brief Epoch based memory reclamation (Fraser, Practical lock-freedom)
+ *
+ * Threads pin the global epoch with an EpochGuard while they dereference shared nodes.
+ * A node unlinked from a lock-free structure is handed to Retire, and its deleter runs
+ * once the global epoch has advanced twice, when no guard taken before the unlink can
+ * still be alive. The epoch only advances when every pinned thread has seen it.
+ *
+ * One domain serves every lock-free container of the process. Thread records are
+ * recycled when threads exit, nodes retired by an exited thread are reclaimed by the
+ * next thread which takes over its record.
+ */
+class EpochDomain {
+public:
+    // retires between two attempts to advance the epoch and reclaim
+    static const uint32_t RECLAIM_THRESHOLD = 64;
+
+    static EpochDomain& Instance() {
+        // records live as long as the process, never destroyed
+        static EpochDomain* domain = new EpochDomain();
+        return *domain;
+    }
+
+    EpochDomain(const EpochDomain& other) = delete;
+    EpochDomain& operator=(const EpochDomain& other) = delete;
+
+    // reentrant, only the outermost Enter/Exit pair pins the epoch
+    void Enter() {
+        Record* record = LocalRecord();
+        if (record->nest_num++ == 0) {
+            // release keeps the previous critical section ordered before the new pin
+            record->epoch.store((global_epoch_.load(std::memory_order_relaxed) << 1) | ACTIVE,
+                                std::memory_order_release);
+            // the pin must be visible before any shared pointer is read, pairs with TryAdvance
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    void Exit() {
+        Record* record = LocalRecord();
+        if (--record->nest_num == 0) {
+            record->epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    // ptr must already be unreachable for threads which enter after this call
+    void Retire(void* ptr, void (*deleter)(void*)) {
+        Record* record = LocalRecord();
+        record->retired.push_back({ptr, deleter, global_epoch_.load(std::memory_order_seq_cst)});
+        if (hippo_unlikely(++record->retire_num % RECLAIM_THRESHOLD == 0)) {
+            TryAdvance();
+            Reclaim(record);
+        }
+    }
+
+    template <typename T>
+    void Retire(T* ptr) {
+        Retire(ptr, [](void* p) { delete static_cast<T*>(p); });
+    }
+
+    // run the deleters of everything the calling thread retired whose grace period is over
+    void Reclaim() {
+        TryAdvance();
+        Reclaim(LocalRecord());
+    }
+
+    uint64_t Epoch() { return global_epoch_.load(std::memory_order_relaxed); }
+
+private:
+    static const uint64_t ACTIVE = 1;
+
+    struct Retired {
+        void* ptr;
+        void (*deleter)(void*);
+        uint64_t epoch;
+    };
+
+    struct Record {
+        // (epoch << 1) | ACTIVE while pinned, 0 otherwise
+        alignas(CACHELINE_SIZE) std::atomic<uint64_t> epoch = {0};
+        std::atomic<bool> in_use = {true};
+        Record* next = nullptr;
+        // owner thread only
+        uint32_t nest_num = 0;
+        uint32_t retire_num = 0;
+        std::vector<Retired> retired;
+    };
+
+    struct LocalHolder {
+        ~LocalHolder() {
+            if (record != nullptr) {
+                record->epoch.store(0, std::memory_order_release);
+                record->nest_num = 0;
+                record->in_use.store(false, std::memory_order_release);
+            }
+        }
+        Record* record = nullptr;
+    };
+
+    EpochDomain() = default;
+
+    Record* LocalRecord() {
+        static thread_local LocalHolder holder;
+        if (hippo_unlikely(holder.record == nullptr)) {
+            holder.record = AcquireRecord();
+        }
+        return holder.record;
+    }
+
+    Record* AcquireRecord() {
+        for (Record* record = records_.load(std::memory_order_acquire); record != nullptr; record = record->next) {
+            bool in_use = false;
+            if (!record->in_use.load(std::memory_order_relaxed) &&
+                record->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire)) {
+                return record;
+            }
+        }
+        Record* record = new Record();
+        Record* head = records_.load(std::memory_order_relaxed);
+        do {
+            record->next = head;
+        } while (!records_.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+        return record;
+    }
+
+    bool TryAdvance() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t epoch = global_epoch_.load(std::memory_order_relaxed);
+        for (Record* record = records_.load(std::memory_order_acquire); record != nullptr; record = record->next) {
+            // acquire, the reads of a finished critical section happen before the reclaim
+            uint64_t local = record->epoch.load(std::memory_order_acquire);
+            if ((local & ACTIVE) && (local >> 1) != epoch) {
+                // a thread is still pinned in an older epoch
+                return false;
+            }
+        }
+        return global_epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel,
+                                                     std::memory_order_relaxed);
+    }
+
+    void Reclaim(Record* record) {
+        uint64_t epoch = global_epoch_.load(std::memory_order_acquire);
+        // retired is sorted by epoch
+        std::size_t num = 0;
+        while (num < record->retired.size() && record->retired[num].epoch + 2 <= epoch) {
+            ++num;
+        }
+        // deleters must not call Retire, it may reallocate the vector
+        for (std::size_t i = 0; i < num; ++i) {
+            record->retired[i].deleter(record->retired[i].ptr);
+        }
+        record->retired.erase(record->retired.begin(), record->retired.begin() + num);
+    }
+
+    alignas(CACHELINE_SIZE) std::atomic<uint64_t> global_epoch_ = {0};
+    alignas(CACHELINE_SIZE) std::atomic<Record*> records_ = {nullptr};
+};
+
+// pins the current epoch for the lifetime of the guard
+class EpochGuard {
+public:
+    EpochGuard() : domain_(EpochDomain::Instance()) { domain_.Enter(); }
+    ~EpochGuard() { domain_.Exit(); }
+    EpochGuard(const EpochGuard& other) = delete;
+    EpochGuard& operator=(const EpochGuard& other) = delete;
+
+private:
+    EpochDomain& domain_;
+};
+
+NAMESPACE_COMMON_END
+NAMESPACE_HIPPO_END
+
+#endif  // !__HIPPO_EPOCH_RECLAIMER_HPP__
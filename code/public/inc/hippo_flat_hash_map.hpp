@@ -0,0 +1,274 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_FLAT_HASH_MAP_HPP__
+#define __HIPPO_FLAT_HASH_MAP_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "hippo_namespace.hpp"
+#include "hippo_hash.hpp"
+#include "hippo_macro.hpp"
+
+NAMESPACE_HIPPO_BEGIN
+NAMESPACE_COMMON_BEGIN
+
+/**
+ * @brief Lock-free fixed capacity hash map with open addressing
+ *
+ * Slots are grouped by 16, every slot has one control byte: empty, busy (being inserted)
+ * or the low 7 bits of the key hash. A lookup loads the 16 control bytes of a group and
+ * matches them at once (SSE2 when available), only slots with the same 7 hash bits have
+ * their key compared, and an empty byte in the group ends the probe. Keys and values are
+ * stored inline, values larger than 8 bytes are guarded by a per slot seqlock.
+ * Set returns false when the table is full.
+ *
+ * @tparam K Type of key, must be integral
+ * @tparam V Type of value, must be trivially copyable
+ * @tparam Hasher Function object returning a uint64_t hash of a key
+ */
+template <typename K, typename V, typename Hasher = DefaultHasher<K>,
+          typename std::enable_if<std::is_integral<K>::value && std::is_trivially_copyable<V>::value, int>::type = 0>
+class FlatAtomicHashMap {
+public:
+    explicit FlatAtomicHashMap(uint64_t capacity = 1024) {
+        group_num_ = 1;
+        while (group_num_ * GROUP_SIZE < capacity) {
+            group_num_ <<= 1;
+        }
+        group_mask_ = group_num_ - 1;
+        ctrl_.reset(new std::atomic<uint64_t>[group_num_ * WORDS_PER_GROUP]);
+        for (uint64_t i = 0; i < group_num_ * WORDS_PER_GROUP; ++i) {
+            ctrl_[i].store(EMPTY_WORD, std::memory_order_relaxed);
+        }
+        slots_.reset(new Slot[group_num_ * GROUP_SIZE]);
+    }
+    FlatAtomicHashMap(const FlatAtomicHashMap &other) = delete;
+    FlatAtomicHashMap &operator=(const FlatAtomicHashMap &other) = delete;
+
+    bool Has(K key) { return Find(key) != nullptr; }
+
+    bool Get(K key, V *value) {
+        Slot *slot = Find(key);
+        if (slot == nullptr) {
+            return false;
+        }
+        *value = slot->value.Load();
+        return true;
+    }
+
+    bool Set(K key) { return Insert(key, V()); }
+
+    bool Set(K key, const V &value) { return Insert(key, value); }
+
+    uint64_t Capacity() const { return group_num_ * GROUP_SIZE; }
+
+private:
+    static const uint64_t GROUP_SIZE = 16;
+    static const uint64_t WORDS_PER_GROUP = GROUP_SIZE / sizeof(uint64_t);
+    static const uint8_t EMPTY = 0x80;
+    static const uint8_t BUSY = 0xFE;
+    static const uint64_t EMPTY_WORD = 0x8080808080808080ULL;
+
+    // value readable while another thread overwrites it
+    class AtomicValue {
+    public:
+        V Load() const {
+            uint64_t words[WORD_NUM];
+            if constexpr (WORD_NUM == 1) {
+                words[0] = words_[0].load(std::memory_order_acquire);
+            } else {
+                uint32_t seq = 0;
+                do {
+                    seq = seq_.load(std::memory_order_acquire);
+                    while (seq & 1) {
+                        hippo_cpu_relax();
+                        seq = seq_.load(std::memory_order_acquire);
+                    }
+                    for (std::size_t i = 0; i < WORD_NUM; ++i) {
+                        words[i] = words_[i].load(std::memory_order_relaxed);
+                    }
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                } while (seq_.load(std::memory_order_relaxed) != seq);
+            }
+            typename std::aligned_storage<sizeof(V), alignof(V)>::type value;
+            std::memcpy(&value, words, sizeof(V));
+            return *reinterpret_cast<V *>(&value);
+        }
+
+        void Store(const V &value) {
+            uint64_t words[WORD_NUM] = {0};
+            std::memcpy(words, &value, sizeof(V));
+            if constexpr (WORD_NUM == 1) {
+                words_[0].store(words[0], std::memory_order_release);
+            } else {
+                // writers serialize on an odd sequence
+                uint32_t seq = seq_.load(std::memory_order_relaxed);
+                while ((seq & 1) ||
+                       !seq_.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    hippo_cpu_relax();
+                    seq = seq_.load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_release);
+                for (std::size_t i = 0; i < WORD_NUM; ++i) {
+                    words_[i].store(words[i], std::memory_order_relaxed);
+                }
+                seq_.store(seq + 2, std::memory_order_release);
+            }
+        }
+
+    private:
+        static constexpr std::size_t WORD_NUM = (sizeof(V) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        std::atomic<uint32_t> seq_ = {0};
+        std::atomic<uint64_t> words_[WORD_NUM] = {};
+    };
+
+    struct Slot {
+        // written once before the control byte is published
+        K key = 0;
+        AtomicValue value;
+    };
+
+    // 16 control bytes, loaded as two atomic words
+    class Group {
+    public:
+        explicit Group(const std::atomic<uint64_t> *ctrl)
+            : low_(ctrl[0].load(std::memory_order_acquire)), high_(ctrl[1].load(std::memory_order_acquire)) {}
+
+        // bit i is set if control byte i equals byte
+        uint32_t Match(uint8_t byte) const {
+#ifdef __SSE2__
+            __m128i ctrl = _mm_set_epi64x(static_cast<int64_t>(high_), static_cast<int64_t>(low_));
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(static_cast<char>(byte)))));
+#else
+            uint32_t mask = 0;
+            for (uint32_t i = 0; i < GROUP_SIZE; ++i) {
+                if (Byte(i) == byte) {
+                    mask |= 1u << i;
+                }
+            }
+            return mask;
+#endif
+        }
+
+        uint8_t Byte(uint32_t index) const {
+            uint64_t word = index < 8 ? low_ : high_;
+            return static_cast<uint8_t>(word >> ((index & 7) * 8));
+        }
+
+    private:
+        uint64_t low_;
+        uint64_t high_;
+    };
+
+    uint64_t Hash(K key) const { return static_cast<uint64_t>(hasher_(key)); }
+
+    std::atomic<uint64_t> &CtrlWord(uint64_t group, uint32_t index) {
+        return ctrl_[group * WORDS_PER_GROUP + index / 8];
+    }
+
+    uint8_t LoadCtrl(uint64_t group, uint32_t index) {
+        return static_cast<uint8_t>(CtrlWord(group, index).load(std::memory_order_acquire) >> ((index & 7) * 8));
+    }
+
+    bool ClaimSlot(uint64_t group, uint32_t index) {
+        auto &word = CtrlWord(group, index);
+        const uint32_t shift = (index & 7) * 8;
+        uint64_t current = word.load(std::memory_order_relaxed);
+        while (static_cast<uint8_t>(current >> shift) == EMPTY) {
+            uint64_t desired = current ^ (static_cast<uint64_t>(EMPTY ^ BUSY) << shift);
+            if (word.compare_exchange_weak(current, desired, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void PublishSlot(uint64_t group, uint32_t index, uint8_t h2) {
+        const uint32_t shift = (index & 7) * 8;
+        CtrlWord(group, index).fetch_xor(static_cast<uint64_t>(BUSY ^ h2) << shift, std::memory_order_release);
+    }
+
+    Slot *Find(K key) {
+        const uint64_t hash = Hash(key);
+        const uint8_t h2 = static_cast<uint8_t>(hash & 0x7f);
+        uint64_t group = (hash >> 7) & group_mask_;
+        for (uint64_t i = 1; i <= group_num_; ++i) {
+            Group ctrl(&ctrl_[group * WORDS_PER_GROUP]);
+            for (uint32_t bits = ctrl.Match(h2); bits != 0; bits &= bits - 1) {
+                Slot *slot = &slots_[group * GROUP_SIZE + __builtin_ctz(bits)];
+                if (slot->key == key) {
+                    return slot;
+                }
+            }
+            // keys are never removed, the probe sequence ends at the first empty slot
+            if (ctrl.Match(EMPTY) != 0) {
+                return nullptr;
+            }
+            // triangular probing visits every group of a power of two table
+            group = (group + i) & group_mask_;
+        }
+        return nullptr;
+    }
+
+    // a busy slot may hold the same key, so wait for it before looking further, this keeps keys unique
+    bool Insert(K key, const V &value) {
+        const uint64_t hash = Hash(key);
+        const uint8_t h2 = static_cast<uint8_t>(hash & 0x7f);
+        uint64_t group = (hash >> 7) & group_mask_;
+        for (uint64_t i = 1; i <= group_num_; ++i) {
+            Group ctrl(&ctrl_[group * WORDS_PER_GROUP]);
+            uint32_t bits = ctrl.Match(h2) | ctrl.Match(BUSY) | ctrl.Match(EMPTY);
+            while (bits != 0) {
+                const uint32_t index = __builtin_ctz(bits);
+                uint8_t byte = LoadCtrl(group, index);
+                while (hippo_unlikely(byte == BUSY)) {
+                    hippo_cpu_relax();
+                    byte = LoadCtrl(group, index);
+                }
+                Slot *slot = &slots_[group * GROUP_SIZE + index];
+                if (byte == EMPTY) {
+                    if (!ClaimSlot(group, index)) {
+                        // lost the race for this slot, look at it again
+                        continue;
+                    }
+                    slot->key = key;
+                    slot->value.Store(value);
+                    PublishSlot(group, index, h2);
+                    return true;
+                }
+                if (byte == h2 && slot->key == key) {
+                    slot->value.Store(value);
+                    return true;
+                }
+                bits &= bits - 1;
+            }
+            group = (group + i) & group_mask_;
+        }
+        // table is full
+        return false;
+    }
+
+    Hasher hasher_;
+    uint64_t group_num_ = 0;
+    uint64_t group_mask_ = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> ctrl_;
+    std::unique_ptr<Slot[]> slots_;
+};
+
+NAMESPACE_COMMON_END
+NAMESPACE_HIPPO_END
+
+#endif  // !__HIPPO_FLAT_HASH_MAP_HPP__
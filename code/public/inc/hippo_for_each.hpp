@@ -28,7 +28,7 @@ typename std::enable_if<!HasLess<Value>::value || !HasLess<End>::value, bool>::t
     return val != end;
 }
 
-#define FOR_EACH(i, begin, end) for (auto i = (true ? (begin) : (end)); apollo::hippo::base::LessThan(i, (end)); ++i)
+#define FOR_EACH(i, begin, end) for (auto i = (true ? (begin) : (end)); Hippo::Common::LessThan(i, (end)); ++i)
 
 NAMESPACE_COMMON_END
 NAMESPACE_HIPPO_END
@@ -0,0 +1,220 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_FUNCTION_HPP__
+#define __HIPPO_FUNCTION_HPP__
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "hippo_namespace.hpp"
+
+#ifndef HIPPO_FUNCTION_INLINE_SIZE
+#define HIPPO_FUNCTION_INLINE_SIZE 64
+#endif
+
+NAMESPACE_HIPPO_BEGIN
+NAMESPACE_COMMON_BEGIN
+
+template <typename Signature, std::size_t InlineSize = HIPPO_FUNCTION_INLINE_SIZE>
+class InplaceFunction;
+
+/**
+ * @brief Move-only std::function replacement with small buffer optimization
+ *
+ * Callables no larger than InlineSize (and nothrow move constructible) are stored
+ * inline, larger ones fall back to the heap. Like std::function, operator() is const
+ * and calls the stored callable as non-const.
+ *
+ * @tparam R Type of result
+ * @tparam Args Type of arguments
+ * @tparam InlineSize Bytes of inline storage
+ */
+template <typename R, typename... Args, std::size_t InlineSize>
+class InplaceFunction<R(Args...), InlineSize> {
+    static_assert(InlineSize >= sizeof(void *), "InlineSize must be able to hold a pointer");
+
+public:
+    InplaceFunction() = default;
+    InplaceFunction(std::nullptr_t) {}  // NOLINT
+    template <typename F, typename = typename std::enable_if<
+                              !std::is_same<typename std::decay<F>::type, InplaceFunction>::value>::type>
+    InplaceFunction(F &&f) {  // NOLINT
+        Emplace(std::forward<F>(f));
+    }
+    InplaceFunction(InplaceFunction &&other) noexcept { MoveFrom(&other); }
+    InplaceFunction &operator=(InplaceFunction &&other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(&other);
+        }
+        return *this;
+    }
+    InplaceFunction(const InplaceFunction &other) = delete;
+    InplaceFunction &operator=(const InplaceFunction &other) = delete;
+    ~InplaceFunction() { Reset(); }
+
+    template <typename F>
+    void Emplace(F &&f) {
+        using Functor = typename std::decay<F>::type;
+        Reset();
+        if constexpr (std::is_pointer<Functor>::value || std::is_member_pointer<Functor>::value) {
+            if (f == nullptr) {
+                return;
+            }
+        }
+        if constexpr (IsInline<Functor>()) {
+            new (&storage_) Functor(std::forward<F>(f));
+            ops_ = &InlineOps<Functor>::ops;
+        } else {
+            *reinterpret_cast<Functor **>(&storage_) = new Functor(std::forward<F>(f));
+            ops_ = &HeapOps<Functor>::ops;
+        }
+    }
+
+    void Reset() {
+        if (ops_ != nullptr) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    R operator()(Args... args) const {
+        if (ops_ == nullptr) {
+            throw std::bad_function_call();
+        }
+        return ops_->invoke(&storage_, std::forward<Args>(args)...);
+    }
+    explicit operator bool() const { return ops_ != nullptr; }
+
+private:
+    struct Ops {
+        R (*invoke)(void *, Args &&...);
+        void (*move)(void *dst, void *src);
+        void (*destroy)(void *);
+    };
+
+    // a void signature drops whatever the callable returns, like std::function
+    template <typename Functor>
+    static R Call(Functor &functor, Args &&... args) {
+        if constexpr (std::is_void<R>::value) {
+            std::invoke(functor, std::forward<Args>(args)...);
+        } else {
+            return std::invoke(functor, std::forward<Args>(args)...);
+        }
+    }
+
+    template <typename Functor>
+    static constexpr bool IsInline() {
+        return sizeof(Functor) <= InlineSize && alignof(Functor) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<Functor>::value;
+    }
+
+    template <typename Functor>
+    struct InlineOps {
+        static R Invoke(void *p, Args &&... args) {
+            return Call(*static_cast<Functor *>(p), std::forward<Args>(args)...);
+        }
+        static void Move(void *dst, void *src) {
+            new (dst) Functor(std::move(*static_cast<Functor *>(src)));
+            static_cast<Functor *>(src)->~Functor();
+        }
+        static void Destroy(void *p) { static_cast<Functor *>(p)->~Functor(); }
+        static constexpr Ops ops = {&Invoke, &Move, &Destroy};
+    };
+
+    template <typename Functor>
+    struct HeapOps {
+        static R Invoke(void *p, Args &&... args) {
+            return Call(**static_cast<Functor **>(p), std::forward<Args>(args)...);
+        }
+        static void Move(void *dst, void *src) { *static_cast<Functor **>(dst) = *static_cast<Functor **>(src); }
+        static void Destroy(void *p) { delete *static_cast<Functor **>(p); }
+        static constexpr Ops ops = {&Invoke, &Move, &Destroy};
+    };
+
+    void MoveFrom(InplaceFunction *other) {
+        if (other->ops_ != nullptr) {
+            other->ops_->move(&storage_, &other->storage_);
+            ops_ = other->ops_;
+            other->ops_ = nullptr;
+        }
+    }
+
+    const Ops *ops_ = nullptr;
+    alignas(std::max_align_t) mutable unsigned char storage_[InlineSize];
+};
+
+template <typename Signature>
+class FunctionRef;
+
+/**
+ * @brief Non-owning reference to a callable, two words, never allocates
+ *
+ * For callbacks which are only called before the function taking them returns. The
+ * callable must outlive the FunctionRef, so do not store one bound to a temporary.
+ *
+ * @tparam R Type of result
+ * @tparam Args Type of arguments
+ */
+template <typename R, typename... Args>
+class FunctionRef<R(Args...)> {
+public:
+    template <typename F, typename = typename std::enable_if<
+                              !std::is_same<typename std::decay<F>::type, FunctionRef>::value>::type>
+    FunctionRef(F &&f) {  // NOLINT
+        using Callable = typename std::remove_reference<F>::type;
+        using Pointer = typename std::decay<F>::type;
+        if constexpr (std::is_pointer<Pointer>::value &&
+                      std::is_function<typename std::remove_pointer<Pointer>::type>::value) {
+            // functions and function pointers are kept by value, a pointer is often a temporary
+            object_.function = reinterpret_cast<void (*)()>(static_cast<Pointer>(f));
+            invoke_ = &InvokeFunction<typename std::remove_pointer<Pointer>::type>;
+        } else {
+            object_.pointer = const_cast<void *>(static_cast<const void *>(std::addressof(f)));
+            invoke_ = &InvokeObject<Callable>;
+        }
+    }
+
+    R operator()(Args... args) const { return invoke_(object_, std::forward<Args>(args)...); }
+
+private:
+    union Object {
+        void *pointer;
+        void (*function)();
+    };
+
+    template <typename F>
+    static R InvokeObject(Object object, Args &&... args) {
+        return Call(*static_cast<F *>(object.pointer), std::forward<Args>(args)...);
+    }
+
+    template <typename F>
+    static R InvokeFunction(Object object, Args &&... args) {
+        return Call(*reinterpret_cast<F *>(object.function), std::forward<Args>(args)...);
+    }
+
+    template <typename F>
+    static R Call(F &f, Args &&... args) {
+        if constexpr (std::is_void<R>::value) {
+            std::invoke(f, std::forward<Args>(args)...);
+        } else {
+            return std::invoke(f, std::forward<Args>(args)...);
+        }
+    }
+
+    Object object_;
+    R (*invoke_)(Object, Args &&...);
+};
+
+NAMESPACE_COMMON_END
+NAMESPACE_HIPPO_END
+
+#endif  // !__HIPPO_FUNCTION_HPP__
@@ -0,0 +1,45 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_HASH_HPP__
+#define __HIPPO_HASH_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "hippo_namespace.hpp"
+
+NAMESPACE_HIPPO_BEGIN
+NAMESPACE_COMMON_BEGIN
+
+// murmur3 finalizer, every input bit affects every output bit
+inline uint64_t HashMix64(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * @brief Default hasher of the hash maps
+ *
+ * std::hash is the identity for integers on common standard libraries, so sequential or
+ * strided ids would only fill a few buckets, its result is mixed before use.
+ *
+ * @tparam K Type of key, must be supported by std::hash
+ */
+template <typename K>
+struct DefaultHasher {
+    uint64_t operator()(const K &key) const { return HashMix64(static_cast<uint64_t>(std::hash<K>()(key))); }
+};
+
+NAMESPACE_COMMON_END
+NAMESPACE_HIPPO_END
+
+#endif  // !__HIPPO_HASH_HPP__
@@ -7,269 +7,450 @@
 #ifndef __HIPPO_HASH_MAP_HPP__
 #define __HIPPO_HASH_MAP_HPP__
 
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
 #include <type_traits>
 #include <utility>
 
 #include "hippo_namespace.hpp"
+#include "hippo_epoch_reclaimer.hpp"
+#include "hippo_hash.hpp"
+#include "hippo_macro.hpp"
 
 NAMESPACE_HIPPO_BEGIN
 NAMESPACE_COMMON_BEGIN
 
 /**
- * @brief A implementation of lock-free fixed size hash map
+ * @brief A implementation of lock-free growable hash map (split-ordered list, Shalev & Shavit)
  *
- * @tparam K Type of key, must be integral
+ * All entries live in one lock-free list sorted by the bit reversed hash, buckets are
+ * shortcuts into that list through dummy entries. When the load factor exceeds
+ * MAX_LOAD_FACTOR the bucket count doubles with a single cas, a new bucket is
+ * initialized by the first operation which touches it by splitting its parent bucket,
+ * so no entry ever moves and readers and writers are never blocked by a rehash. The bucket
+ * count halves again when the load factor drops under 1 / SHRINK_LOAD_FACTOR.
+ *
+ * Erase marks the next pointer of an entry before unlinking it (Harris, Michael). Erased
+ * entries and replaced values are retired to the EpochDomain, a pointer returned by
+ * Get(K, V**) stays valid as long as the caller holds an EpochGuard taken before the call.
+ *
+ * Every entry keeps its hash in the split-order key, which is compared before the keys
+ * themselves, so long keys such as strings are only compared when their hashes match.
+ *
+ * @tparam K Type of key, must be copy constructible and equality comparable
  * @tparam V Type of value
- * @tparam 128 Size of hash table
- * @tparam 0 Type traits, use for checking types of key & value
+ * @tparam 128 Initial number of buckets
+ * @tparam Hasher Function object returning a uint64_t hash of a key
+ * @tparam Allocator Allocator of the entries and values, its resource must outlive the ones
+ *         retired to the EpochDomain
+ * @tparam 0 Type traits, use for checking the table size
  */
-template <typename K, typename V, std::size_t TableSize = 128,
-          typename std::enable_if<std::is_integral<K>::value && (TableSize & (TableSize - 1)) == 0, int>::type = 0>
+template <typename K, typename V, std::size_t TableSize = 128, typename Hasher = DefaultHasher<K>,
+          typename Allocator = std::allocator<std::pair<const K, V>>,
+          typename std::enable_if<(TableSize & (TableSize - 1)) == 0, int>::type = 0>
 class AtomicHashMap {
 public:
-    AtomicHashMap() : capacity_(TableSize), mode_num_(capacity_ - 1) {}
+    using allocator_type = Allocator;
+
+    struct Metrics {
+        uint64_t size;
+        uint64_t bucket_num;
+        // buckets split so far, capped at bucket_num since a shrink keeps the buckets it drops
+        // initialized, so resize progress initialized_bucket_num / bucket_num stays within [0, 1]
+        uint64_t initialized_bucket_num;
+        uint64_t resize_num;
+        double load_factor;
+    };
+
+    static const uint64_t MAX_LOAD_FACTOR = 2;
+    static const uint64_t SHRINK_LOAD_FACTOR = 8;
+
+    AtomicHashMap() : AtomicHashMap(Allocator()) {}
+    explicit AtomicHashMap(const Allocator &allocator)
+        : entry_allocator_(allocator), value_allocator_(allocator), bucket_num_(TableSize) {
+        Entry *head = NewNode<Entry>(entry_allocator_, 0);
+        GetBucket(0)->store(head, std::memory_order_release);
+    }
     AtomicHashMap(const AtomicHashMap &other) = delete;
     AtomicHashMap &operator=(const AtomicHashMap &other) = delete;
+    ~AtomicHashMap() {
+        Entry *ite = GetBucket(0)->load(std::memory_order_acquire);
+        while (ite) {
+            auto tmp = Unmark(ite->next.load(std::memory_order_acquire));
+            DeleteNode<Entry>(ite);
+            ite = tmp;
+        }
+        for (auto &segment : segments_) {
+            std::free(segment.load(std::memory_order_acquire));
+        }
+    }
 
-    bool Has(K key) {
-        uint64_t index = key & mode_num_;
-        return table_[index].Has(key);
+    bool Has(const K &key) {
+        EpochGuard guard;
+        Entry *prev = nullptr;
+        Entry *target = nullptr;
+        return Find(key, &prev, &target);
     }
 
-    bool Get(K key, V **value) {
-        uint64_t index = key & mode_num_;
-        return table_[index].Get(key, value);
+    bool Get(const K &key, V **value) {
+        EpochGuard guard;
+        Entry *prev = nullptr;
+        Entry *target = nullptr;
+        if (Find(key, &prev, &target)) {
+            *value = &target->value_ptr.load(std::memory_order_acquire)->data;
+            return true;
+        }
+        return false;
     }
 
-    bool Get(K key, V *value) {
-        uint64_t index = key & mode_num_;
+    bool Get(const K &key, V *value) {
+        EpochGuard guard;
         V *val = nullptr;
-        bool res = table_[index].Get(key, &val);
+        bool res = Get(key, &val);
         if (res) {
             *value = *val;
         }
         return res;
     }
 
-    void Set(K key) {
-        uint64_t index = key & mode_num_;
-        table_[index].Insert(key);
-    }
+    void Set(const K &key) { Insert(key); }
+
+    void Set(const K &key, const V &value) { Insert(key, value); }
+
+    void Set(const K &key, V &&value) { Insert(key, std::forward<V>(value)); }
 
-    void Set(K key, const V &value) {
-        uint64_t index = key & mode_num_;
-        table_[index].Insert(key, value);
+    // return false if key does not exist
+    bool Erase(const K &key) {
+        EpochGuard guard;
+        const uint64_t hash = Hash(key);
+        const uint64_t so_key = EntrySoKey(hash);
+        Entry *head = GetBucketHead(hash & (bucket_num_.load(std::memory_order_acquire) - 1));
+        Entry *prev = nullptr;
+        Entry *target = nullptr;
+        Entry *next = nullptr;
+        while (true) {
+            if (!ListFind(head, so_key, &key, &prev, &target)) {
+                return false;
+            }
+            next = target->next.load(std::memory_order_acquire);
+            // logical deletion, the winner of the mark owns the erase
+            if (!IsMarked(next) && target->next.compare_exchange_weak(next, Mark(next), std::memory_order_acq_rel,
+                                                                      std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        Entry *expected = target;
+        if (prev->next.compare_exchange_strong(expected, next, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            EpochDomain::Instance().Retire(target, &DeleteNode<Entry>);
+        } else {
+            // let a traversal unlink it
+            ListFind(head, so_key, &key, &prev, &target);
+        }
+        Shrink(size_.fetch_sub(1, std::memory_order_relaxed) - 1);
+        return true;
     }
 
-    void Set(K key, V &&value) {
-        uint64_t index = key & mode_num_;
-        table_[index].Insert(key, std::forward<V>(value));
+    Metrics GetMetrics() {
+        Metrics metrics;
+        metrics.size = size_.load(std::memory_order_relaxed);
+        metrics.bucket_num = bucket_num_.load(std::memory_order_relaxed);
+        metrics.initialized_bucket_num =
+            std::min(initialized_bucket_num_.load(std::memory_order_relaxed), metrics.bucket_num);
+        metrics.resize_num = resize_num_.load(std::memory_order_relaxed);
+        metrics.load_factor = static_cast<double>(metrics.size) / metrics.bucket_num;
+        return metrics;
     }
 
+    uint64_t Size() { return size_.load(std::memory_order_relaxed); }
+
 private:
-    struct Entry {
-        Entry() {}
-        explicit Entry(K key) : key(key) { value_ptr.store(new V(), std::memory_order_release); }
-        Entry(K key, const V &value) : key(key) { value_ptr.store(new V(value), std::memory_order_release); }
-        Entry(K key, V &&value) : key(key) {
-            value_ptr.store(new V(std::forward<V>(value)), std::memory_order_release);
-        }
-        ~Entry() { delete value_ptr.load(std::memory_order_acquire); }
+    // segment 0 holds TableSize buckets, segment i holds TableSize << (i - 1)
+    static const int MAX_SEGMENT_NUM = 48;
 
-        K key = 0;
-        std::atomic<V *> value_ptr = {nullptr};
-        std::atomic<Entry *> next = {nullptr};
+    struct Entry;
+    struct Value;
+    using EntryAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Entry>;
+    using ValueAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Value>;
+
+    // a node frees itself with its own copy of the allocator, the map may be gone by then.
+    // Empty allocators take no room (empty base)
+    template <typename NodeAllocator>
+    struct AllocatorHolder : NodeAllocator {
+        explicit AllocatorHolder(const NodeAllocator &allocator) : NodeAllocator(allocator) {}
+        const NodeAllocator &GetAllocator() const { return *this; }
     };
 
-    class Bucket {
-    public:
-        Bucket() : head_(new Entry()) {}
-        ~Bucket() {
-            Entry *ite = head_;
-            while (ite) {
-                auto tmp = ite->next.load(std::memory_order_acquire);
-                delete ite;
-                ite = tmp;
+    struct Value : AllocatorHolder<ValueAllocator> {
+        template <typename... Args>
+        explicit Value(const ValueAllocator &allocator, Args &&... args)
+            : AllocatorHolder<ValueAllocator>(allocator), data(std::forward<Args>(args)...) {}
+        V data;
+    };
+
+    struct Entry : AllocatorHolder<EntryAllocator> {
+        // dummy entry of a bucket
+        Entry(const EntryAllocator &allocator, uint64_t so_key)
+            : AllocatorHolder<EntryAllocator>(allocator), so_key(so_key) {}
+        // takes the ownership of value
+        Entry(const EntryAllocator &allocator, uint64_t so_key, const K &key, Value *value)
+            : AllocatorHolder<EntryAllocator>(allocator), so_key(so_key) {
+            new (&key_storage) K(key);
+            value_ptr.store(value, std::memory_order_release);
+        }
+        ~Entry() {
+            if (!IsDummy()) {
+                Key().~K();
+            }
+            Value *value = value_ptr.load(std::memory_order_acquire);
+            if (value != nullptr) {
+                DeleteNode<Value>(value);
             }
         }
 
-        bool Has(K key) {
-            Entry *m_target = head_->next.load(std::memory_order_acquire);
-            while (Entry *target = m_target) {
-                if (target->key < key) {
-                    m_target = target->next.load(std::memory_order_acquire);
-                    continue;
-                } else {
-                    return target->key == key;
-                }
-            }
-            return false;
+        bool IsDummy() const { return (so_key & 1) == 0; }
+        const K &Key() const { return *reinterpret_cast<const K *>(&key_storage); }
+
+        // bit reversed hash, odd for entries and even for dummies
+        uint64_t so_key = 0;
+        // dummies have no key
+        typename std::aligned_storage<sizeof(K), alignof(K)>::type key_storage;
+        std::atomic<Value *> value_ptr = {nullptr};
+        std::atomic<Entry *> next = {nullptr};
+    };
+
+    template <typename Node, typename NodeAllocator, typename... Args>
+    static Node *NewNode(NodeAllocator &allocator, Args &&... args) {
+        using Traits = std::allocator_traits<NodeAllocator>;
+        Node *node = Traits::allocate(allocator, 1);
+        try {
+            return new (node) Node(allocator, std::forward<Args>(args)...);
+        } catch (...) {
+            Traits::deallocate(allocator, node, 1);
+            throw;
         }
+    }
 
-        bool Find(K key, Entry **prev_ptr, Entry **target_ptr) {
-            Entry *prev = head_;
-            Entry *m_target = head_->next.load(std::memory_order_acquire);
-            while (Entry *target = m_target) {
-                if (target->key == key) {
-                    *prev_ptr = prev;
-                    *target_ptr = target;
-                    return true;
-                } else if (target->key > key) {
-                    *prev_ptr = prev;
-                    *target_ptr = target;
-                    return false;
-                } else {
-                    prev = target;
-                    m_target = target->next.load(std::memory_order_acquire);
-                }
+    // also the deleter of retired nodes
+    template <typename Node>
+    static void DeleteNode(void *ptr) {
+        Node *node = static_cast<Node *>(ptr);
+        auto allocator = node->GetAllocator();
+        node->~Node();
+        std::allocator_traits<decltype(allocator)>::deallocate(allocator, node, 1);
+    }
+
+    uint64_t Hash(const K &key) const { return static_cast<uint64_t>(hasher_(key)); }
+
+    // the lowest bit of next marks its entry as erased
+    static bool IsMarked(Entry *entry) { return reinterpret_cast<uintptr_t>(entry) & 1; }
+    static Entry *Mark(Entry *entry) { return reinterpret_cast<Entry *>(reinterpret_cast<uintptr_t>(entry) | 1); }
+    static Entry *Unmark(Entry *entry) {
+        return reinterpret_cast<Entry *>(reinterpret_cast<uintptr_t>(entry) & ~static_cast<uintptr_t>(1));
+    }
+
+    static uint64_t Reverse(uint64_t bits) {
+        bits = ((bits >> 1) & 0x5555555555555555ULL) | ((bits & 0x5555555555555555ULL) << 1);
+        bits = ((bits >> 2) & 0x3333333333333333ULL) | ((bits & 0x3333333333333333ULL) << 2);
+        bits = ((bits >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((bits & 0x0F0F0F0F0F0F0F0FULL) << 4);
+        return __builtin_bswap64(bits);
+    }
+
+    static uint64_t EntrySoKey(uint64_t hash) { return Reverse(hash | (1ULL << 63)); }
+    static uint64_t DummySoKey(uint64_t bucket) { return Reverse(bucket); }
+
+    std::atomic<Entry *> *GetBucket(uint64_t bucket) {
+        int index = 0;
+        uint64_t offset = bucket;
+        if (bucket >= TableSize) {
+            index = 64 - __builtin_clzll(bucket / TableSize);
+            offset = bucket - (static_cast<uint64_t>(TableSize) << (index - 1));
+        }
+        auto *segment = segments_[index].load(std::memory_order_acquire);
+        if (hippo_unlikely(segment == nullptr)) {
+            std::size_t size = index == 0 ? TableSize : static_cast<std::size_t>(TableSize) << (index - 1);
+            // a zeroed atomic pointer array is a valid array of nullptr
+            auto *new_segment =
+                static_cast<std::atomic<Entry *> *>(HIPPO_CHECK_CALLOC(size, sizeof(std::atomic<Entry *>)));
+            if (segments_[index].compare_exchange_strong(segment, new_segment, std::memory_order_acq_rel,
+                                                         std::memory_order_acquire)) {
+                segment = new_segment;
+            } else {
+                std::free(new_segment);
             }
-            *prev_ptr = prev;
-            *target_ptr = nullptr;
-            return false;
         }
+        return &segment[offset];
+    }
 
-        void Insert(K key, const V &value) {
-            Entry *prev = nullptr;
-            Entry *target = nullptr;
-            Entry *new_entry = nullptr;
-            V *new_value = nullptr;
-            while (true) {
-                if (Find(key, &prev, &target)) {
-                    // key exists, update value
-                    if (!new_value) {
-                        new_value = new V(value);
-                    }
-                    auto old_val_ptr = target->value_ptr.load(std::memory_order_acquire);
-                    if (target->value_ptr.compare_exchange_strong(old_val_ptr, new_value, std::memory_order_acq_rel,
-                                                                  std::memory_order_relaxed)) {
-                        delete old_val_ptr;
-                        if (new_entry) {
-                            delete new_entry;
-                            new_entry = nullptr;
-                        }
-                        return;
-                    }
-                    continue;
-                } else {
-                    if (!new_entry) {
-                        new_entry = new Entry(key, value);
-                    }
-                    new_entry->next.store(target, std::memory_order_release);
-                    if (prev->next.compare_exchange_strong(target, new_entry, std::memory_order_acq_rel,
-                                                           std::memory_order_relaxed)) {
-                        // Insert success
-                        if (new_value) {
-                            delete new_value;
-                            new_value = nullptr;
-                        }
-                        return;
-                    }
-                    // another entry has been inserted, retry
-                }
+    // dummy entry of bucket, split it from its parent bucket on first use
+    Entry *GetBucketHead(uint64_t bucket) {
+        auto *slot = GetBucket(bucket);
+        Entry *head = slot->load(std::memory_order_acquire);
+        if (hippo_likely(head != nullptr)) {
+            return head;
+        }
+        // parent bucket is bucket without its most significant bit
+        uint64_t parent = bucket & ~(1ULL << (63 - __builtin_clzll(bucket)));
+        Entry *parent_head = GetBucketHead(parent);
+        Entry *dummy = NewNode<Entry>(entry_allocator_, DummySoKey(bucket));
+        Entry *prev = nullptr;
+        Entry *target = nullptr;
+        while (true) {
+            if (ListFind(parent_head, dummy->so_key, nullptr, &prev, &target)) {
+                // another thread inserted the dummy
+                DeleteNode<Entry>(dummy);
+                dummy = target;
+                break;
+            }
+            dummy->next.store(target, std::memory_order_relaxed);
+            if (prev->next.compare_exchange_strong(target, dummy, std::memory_order_acq_rel,
+                                                   std::memory_order_relaxed)) {
+                break;
             }
         }
+        Entry *expected = nullptr;
+        if (slot->compare_exchange_strong(expected, dummy, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            initialized_bucket_num_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return dummy;
+    }
 
-        void Insert(K key, V &&value) {
-            Entry *prev = nullptr;
-            Entry *target = nullptr;
-            Entry *new_entry = nullptr;
-            V *new_value = nullptr;
-            while (true) {
-                if (Find(key, &prev, &target)) {
-                    // key exists, update value
-                    if (!new_value) {
-                        new_value = new V(std::forward<V>(value));
-                    }
-                    auto old_val_ptr = target->value_ptr.load(std::memory_order_acquire);
-                    if (target->value_ptr.compare_exchange_strong(old_val_ptr, new_value, std::memory_order_acq_rel,
-                                                                  std::memory_order_relaxed)) {
-                        delete old_val_ptr;
-                        if (new_entry) {
-                            delete new_entry;
-                            new_entry = nullptr;
-                        }
-                        return;
+    // search the list from head for so_key (and key if not nullptr), on return target is the
+    // match or the first entry ordered after it, prev is the entry before target.
+    // Erased entries met on the way are unlinked and retired, must run under an EpochGuard.
+    bool ListFind(Entry *head, uint64_t so_key, const K *key, Entry **prev_ptr, Entry **target_ptr) {
+        while (true) {
+            Entry *prev = head;
+            Entry *target = Unmark(head->next.load(std::memory_order_acquire));
+            bool restart = false;
+            while (target != nullptr) {
+                Entry *next = target->next.load(std::memory_order_acquire);
+                if (IsMarked(next)) {
+                    Entry *expected = target;
+                    if (!prev->next.compare_exchange_strong(expected, Unmark(next), std::memory_order_acq_rel,
+                                                            std::memory_order_relaxed)) {
+                        // prev changed or has been erased too
+                        restart = true;
+                        break;
                     }
+                    EpochDomain::Instance().Retire(target, &DeleteNode<Entry>);
+                    target = Unmark(next);
                     continue;
-                } else {
-                    if (!new_entry) {
-                        new_entry = new Entry(key, value);
-                    }
-                    new_entry->next.store(target, std::memory_order_release);
-                    if (prev->next.compare_exchange_strong(target, new_entry, std::memory_order_acq_rel,
-                                                           std::memory_order_relaxed)) {
-                        // Insert success
-                        if (new_value) {
-                            delete new_value;
-                            new_value = nullptr;
-                        }
-                        return;
-                    }
-                    // another entry has been inserted, retry
                 }
+                if (target->so_key > so_key) {
+                    break;
+                }
+                // entries of different keys may share a so_key, they are kept next to each other
+                if (target->so_key == so_key && (key == nullptr || target->Key() == *key)) {
+                    *prev_ptr = prev;
+                    *target_ptr = target;
+                    return true;
+                }
+                prev = target;
+                target = next;
+            }
+            if (!restart) {
+                *prev_ptr = prev;
+                *target_ptr = target;
+                return false;
             }
         }
+    }
 
-        void Insert(K key) {
-            Entry *prev = nullptr;
-            Entry *target = nullptr;
-            Entry *new_entry = nullptr;
-            V *new_value = nullptr;
-            while (true) {
-                if (Find(key, &prev, &target)) {
-                    // key exists, update value
-                    if (!new_value) {
-                        new_value = new V();
-                    }
-                    auto old_val_ptr = target->value_ptr.load(std::memory_order_acquire);
-                    if (target->value_ptr.compare_exchange_strong(old_val_ptr, new_value, std::memory_order_acq_rel,
-                                                                  std::memory_order_relaxed)) {
-                        delete old_val_ptr;
-                        if (new_entry) {
-                            delete new_entry;
-                            new_entry = nullptr;
+    bool Find(const K &key, Entry **prev_ptr, Entry **target_ptr) {
+        const uint64_t hash = Hash(key);
+        Entry *head = GetBucketHead(hash & (bucket_num_.load(std::memory_order_acquire) - 1));
+        return ListFind(head, EntrySoKey(hash), &key, prev_ptr, target_ptr);
+    }
+
+    template <typename... Args>
+    void Insert(const K &key, Args &&... args) {
+        EpochGuard guard;
+        const uint64_t hash = Hash(key);
+        const uint64_t so_key = EntrySoKey(hash);
+        Entry *head = GetBucketHead(hash & (bucket_num_.load(std::memory_order_acquire) - 1));
+        Entry *prev = nullptr;
+        Entry *target = nullptr;
+        Entry *new_entry = nullptr;
+        Value *new_value = NewNode<Value>(value_allocator_, std::forward<Args>(args)...);
+        while (true) {
+            if (ListFind(head, so_key, &key, &prev, &target)) {
+                // key exists, update value
+                auto old_val_ptr = target->value_ptr.load(std::memory_order_acquire);
+                if (target->value_ptr.compare_exchange_strong(old_val_ptr, new_value, std::memory_order_acq_rel,
+                                                              std::memory_order_relaxed)) {
+                    if (hippo_unlikely(IsMarked(target->next.load(std::memory_order_acquire)))) {
+                        // an Erase has marked target meanwhile and new_value would go with it, put the old
+                        // value back and insert again. If another Set replaced new_value, it retries for us
+                        Value *expected = new_value;
+                        if (target->value_ptr.compare_exchange_strong(expected, old_val_ptr, std::memory_order_acq_rel,
+                                                                      std::memory_order_relaxed)) {
+                            continue;
                         }
-                        return;
                     }
-                    continue;
-                } else {
-                    if (!new_entry) {
-                        new_entry = new Entry(key);
-                    }
-                    new_entry->next.store(target, std::memory_order_release);
-                    if (prev->next.compare_exchange_strong(target, new_entry, std::memory_order_acq_rel,
-                                                           std::memory_order_relaxed)) {
-                        // Insert success
-                        if (new_value) {
-                            delete new_value;
-                            new_value = nullptr;
-                        }
-                        return;
+                    // readers may still hold the old value
+                    EpochDomain::Instance().Retire(old_val_ptr, &DeleteNode<Value>);
+                    if (new_entry) {
+                        // the value now belongs to target
+                        new_entry->value_ptr.store(nullptr, std::memory_order_relaxed);
+                        DeleteNode<Entry>(new_entry);
                     }
-                    // another entry has been inserted, retry
+                    return;
                 }
+                continue;
+            } else {
+                if (!new_entry) {
+                    new_entry = NewNode<Entry>(entry_allocator_, so_key, key, new_value);
+                }
+                new_entry->next.store(target, std::memory_order_release);
+                if (prev->next.compare_exchange_strong(target, new_entry, std::memory_order_acq_rel,
+                                                       std::memory_order_relaxed)) {
+                    // Insert success
+                    Grow(size_.fetch_add(1, std::memory_order_relaxed) + 1);
+                    return;
+                }
+                // another entry has been inserted, retry
             }
         }
+    }
 
-        bool Get(K key, V **value) {
-            Entry *prev = nullptr;
-            Entry *target = nullptr;
-            if (Find(key, &prev, &target)) {
-                *value = target->value_ptr.load(std::memory_order_acquire);
-                return true;
-            }
-            return false;
+    // double the bucket count, the new buckets are split lazily
+    void Grow(uint64_t size) {
+        uint64_t bucket_num = bucket_num_.load(std::memory_order_relaxed);
+        if (hippo_likely(size <= bucket_num * MAX_LOAD_FACTOR)) {
+            return;
+        }
+        if (bucket_num < (static_cast<uint64_t>(TableSize) << (MAX_SEGMENT_NUM - 1)) &&
+            bucket_num_.compare_exchange_strong(bucket_num, bucket_num << 1, std::memory_order_acq_rel,
+                                                std::memory_order_relaxed)) {
+            resize_num_.fetch_add(1, std::memory_order_relaxed);
         }
+    }
 
-        Entry *head_;
-    };
+    // halve the bucket count, a bucket of the smaller table is the parent of the buckets it
+    // covered, the dummies of those buckets simply stay in the list
+    void Shrink(uint64_t size) {
+        uint64_t bucket_num = bucket_num_.load(std::memory_order_relaxed);
+        if (hippo_likely(bucket_num <= TableSize || size >= bucket_num / SHRINK_LOAD_FACTOR)) {
+            return;
+        }
+        if (bucket_num_.compare_exchange_strong(bucket_num, bucket_num >> 1, std::memory_order_acq_rel,
+                                                std::memory_order_relaxed)) {
+            resize_num_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
 
-private:
-    Bucket table_[TableSize];
-    uint64_t capacity_;
-    uint64_t mode_num_;
+    Hasher hasher_;
+    EntryAllocator entry_allocator_;
+    ValueAllocator value_allocator_;
+    std::atomic<std::atomic<Entry *> *> segments_[MAX_SEGMENT_NUM] = {};
+    alignas(CACHELINE_SIZE) std::atomic<uint64_t> bucket_num_;
+    std::atomic<uint64_t> initialized_bucket_num_ = {1};
+    std::atomic<uint64_t> resize_num_ = {0};
+    alignas(CACHELINE_SIZE) std::atomic<uint64_t> size_ = {0};
 };
 
 NAMESPACE_COMMON_END
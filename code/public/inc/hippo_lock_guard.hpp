@@ -9,6 +9,7 @@
 
 #include <unistd.h>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
@@ -25,25 +26,87 @@ template <typename RWLock>
 class ReadLockGuard {
 public:
     explicit ReadLockGuard(RWLock& lock) : rw_lock_(lock) { rw_lock_.ReadLock(); }
-    ~ReadLockGuard() { rw_lock_.ReadUnlock(); }
+    // gives up after timeout, check OwnsLock
+    template <typename Rep, typename Period>
+    ReadLockGuard(RWLock& lock, const std::chrono::duration<Rep, Period>& timeout)
+        : rw_lock_(lock), owns_lock_(rw_lock_.TryReadLockFor(timeout)) {}
+    ~ReadLockGuard() {
+        if (owns_lock_) {
+            rw_lock_.ReadUnlock();
+        }
+    }
+
+    bool OwnsLock() const { return owns_lock_; }
 
 private:
     ReadLockGuard(const ReadLockGuard& other) = delete;
     ReadLockGuard& operator=(const ReadLockGuard& other) = delete;
     RWLock& rw_lock_;
+    bool owns_lock_ = true;
 };
 
 template <typename RWLock>
 class WriteLockGuard {
 public:
     explicit WriteLockGuard(RWLock& lock) : rw_lock_(lock) { rw_lock_.WriteLock(); }
+    // gives up after timeout, check OwnsLock
+    template <typename Rep, typename Period>
+    WriteLockGuard(RWLock& lock, const std::chrono::duration<Rep, Period>& timeout)
+        : rw_lock_(lock), owns_lock_(rw_lock_.TryWriteLockFor(timeout)) {}
+
+    ~WriteLockGuard() {
+        if (owns_lock_) {
+            rw_lock_.WriteUnlock();
+        }
+    }
 
-    ~WriteLockGuard() { rw_lock_.WriteUnlock(); }
+    bool OwnsLock() const { return owns_lock_; }
 
 private:
     WriteLockGuard(const WriteLockGuard& other) = delete;
     WriteLockGuard& operator=(const WriteLockGuard& other) = delete;
     RWLock& rw_lock_;
+    bool owns_lock_ = true;
+};
+
+// read lock which excludes other upgradeable holders and can be turned into the write lock
+template <typename RWLock>
+class UpgradeLockGuard {
+public:
+    explicit UpgradeLockGuard(RWLock& lock) : rw_lock_(lock) { rw_lock_.UpgradeLock(); }
+    // gives up after timeout, check OwnsLock
+    template <typename Rep, typename Period>
+    UpgradeLockGuard(RWLock& lock, const std::chrono::duration<Rep, Period>& timeout)
+        : rw_lock_(lock), owns_lock_(rw_lock_.TryUpgradeLockFor(timeout)) {}
+
+    ~UpgradeLockGuard() {
+        if (!owns_lock_) {
+            return;
+        }
+        if (upgraded_) {
+            rw_lock_.WriteUnlock();
+        } else {
+            rw_lock_.UpgradeUnlock();
+        }
+    }
+
+    // waits for the readers to leave, nobody can write between the read and the upgrade
+    void Upgrade() {
+        if (owns_lock_ && !upgraded_) {
+            rw_lock_.Upgrade();
+            upgraded_ = true;
+        }
+    }
+
+    bool OwnsLock() const { return owns_lock_; }
+    bool Upgraded() const { return upgraded_; }
+
+private:
+    UpgradeLockGuard(const UpgradeLockGuard& other) = delete;
+    UpgradeLockGuard& operator=(const UpgradeLockGuard& other) = delete;
+    RWLock& rw_lock_;
+    bool owns_lock_ = true;
+    bool upgraded_ = false;
 };
 
 NAMESPACE_COMMON_END
@@ -19,6 +19,19 @@
 #define hippo_unlikely(x) (x)
 #endif
 
+// hint the cpu that we are in a spin loop
+#if defined(__x86_64__) || defined(__i386__)
+#define hippo_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define hippo_cpu_relax() asm volatile("yield" ::: "memory")
+#else
+#define hippo_cpu_relax()
+#endif
+
+#ifndef CACHELINE_SIZE
+#define CACHELINE_SIZE 64
+#endif
+
 #define DEFINE_TYPE_TRAIT(name, func)                          \
     template <typename T>                                      \
     struct name {                                              \
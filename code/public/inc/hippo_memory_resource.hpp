@@ -0,0 +1,272 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_MEMORY_RESOURCE_HPP__
+#define __HIPPO_MEMORY_RESOURCE_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+#include "hippo_namespace.hpp"
+#include "hippo_macro.hpp"
+
+NAMESPACE_HIPPO_BEGIN
+NAMESPACE_COMMON_BEGIN
+
+/**
+ * @brief Monotonic bump pointer arena
+ *
+ * Allocation moves a cursor inside the current chunk, deallocation does nothing and
+ * Reset frees everything at once while keeping the chunks for the next round, so
+ * request scoped work pays for its chunks only on the first requests. Allocations
+ * larger than half a chunk get their own block from upstream, freed by Reset.
+ * Not thread safe, use one arena per thread or per request.
+ */
+class ArenaResource final : public std::pmr::memory_resource {
+public:
+    static const std::size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    explicit ArenaResource(std::size_t chunk_size = DEFAULT_CHUNK_SIZE,
+                           std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : chunk_size_(std::max<std::size_t>(chunk_size, CACHELINE_SIZE)), upstream_(upstream) {}
+    ArenaResource(const ArenaResource& other) = delete;
+    ArenaResource& operator=(const ArenaResource& other) = delete;
+    ~ArenaResource() override { Release(); }
+
+    // free every allocation, the chunks stay for reuse
+    void Reset() {
+        for (auto& block : large_blocks_) {
+            upstream_->deallocate(block.data, block.size, block.alignment);
+        }
+        large_blocks_.clear();
+        used_chunk_num_ = 0;
+        cursor_ = 0;
+        end_ = 0;
+    }
+
+    // free every allocation and give the chunks back to upstream
+    void Release() {
+        Reset();
+        for (auto& chunk : chunks_) {
+            upstream_->deallocate(chunk.data, chunk.size, chunk.alignment);
+        }
+        chunks_.clear();
+    }
+
+    // bytes held from upstream
+    std::size_t Capacity() const {
+        std::size_t capacity = chunks_.size() * chunk_size_;
+        for (auto& block : large_blocks_) {
+            capacity += block.size;
+        }
+        return capacity;
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        bytes = std::max<std::size_t>(bytes, 1);
+        uintptr_t ptr = (cursor_ + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+        if (hippo_likely(ptr + bytes <= end_)) {
+            cursor_ = ptr + bytes;
+            return reinterpret_cast<void*>(ptr);
+        }
+        return AllocateSlow(bytes, alignment);
+    }
+
+    void do_deallocate(void* /* ptr */, std::size_t /* bytes */, std::size_t /* alignment */) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+private:
+    struct Block {
+        void* data;
+        std::size_t size;
+        std::size_t alignment;
+    };
+
+    void* AllocateSlow(std::size_t bytes, std::size_t alignment) {
+        if (bytes + alignment > chunk_size_ / 2) {
+            void* data = upstream_->allocate(bytes, alignment);
+            large_blocks_.push_back({data, bytes, alignment});
+            return data;
+        }
+        if (used_chunk_num_ == chunks_.size()) {
+            chunks_.push_back({upstream_->allocate(chunk_size_, CACHELINE_SIZE), chunk_size_, CACHELINE_SIZE});
+        }
+        cursor_ = reinterpret_cast<uintptr_t>(chunks_[used_chunk_num_].data);
+        end_ = cursor_ + chunk_size_;
+        ++used_chunk_num_;
+        // fits, a new chunk has room for twice the request
+        return do_allocate(bytes, alignment);
+    }
+
+    std::size_t chunk_size_;
+    std::pmr::memory_resource* upstream_;
+    uintptr_t cursor_ = 0;
+    uintptr_t end_ = 0;
+    std::size_t used_chunk_num_ = 0;
+    std::vector<Block> chunks_;
+    std::vector<Block> large_blocks_;
+};
+
+/**
+ * @brief Thread safe size class slab allocator
+ *
+ * Requests up to MAX_OBJECT_SIZE are rounded up to a power of two size class. Each class
+ * carves its blocks out of SLAB_SIZE slabs taken from upstream and keeps the freed ones
+ * on a free list behind its own lock, so classes never contend with each other. Larger
+ * or over aligned requests go straight to upstream. Slabs are only returned by Release
+ * or the destructor.
+ */
+class SlabResource final : public std::pmr::memory_resource {
+public:
+    static const std::size_t MIN_OBJECT_SIZE = 16;
+    static const std::size_t MAX_OBJECT_SIZE = 4096;
+    static const std::size_t SLAB_SIZE = 64 * 1024;
+
+    explicit SlabResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : upstream_(upstream) {}
+    SlabResource(const SlabResource& other) = delete;
+    SlabResource& operator=(const SlabResource& other) = delete;
+    ~SlabResource() override { Release(); }
+
+    // give every slab back to upstream, blocks still in use become invalid
+    void Release() {
+        for (auto& size_class : classes_) {
+            std::lock_guard<std::mutex> lock(size_class.mutex);
+            for (void* slab : size_class.slabs) {
+                upstream_->deallocate(slab, SLAB_SIZE, CACHELINE_SIZE);
+            }
+            size_class.slabs.clear();
+            size_class.free_list = nullptr;
+            size_class.cursor = 0;
+            size_class.end = 0;
+        }
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if (bytes > MAX_OBJECT_SIZE || alignment > CACHELINE_SIZE) {
+            return upstream_->allocate(bytes, alignment);
+        }
+        const std::size_t index = ClassIndex(std::max(bytes, alignment));
+        SizeClass& size_class = classes_[index];
+        const std::size_t size = MIN_OBJECT_SIZE << index;
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        if (size_class.free_list != nullptr) {
+            FreeBlock* block = size_class.free_list;
+            size_class.free_list = block->next;
+            return block;
+        }
+        if (size_class.cursor + size > size_class.end) {
+            void* slab = upstream_->allocate(SLAB_SIZE, CACHELINE_SIZE);
+            size_class.slabs.push_back(slab);
+            size_class.cursor = reinterpret_cast<uintptr_t>(slab);
+            size_class.end = size_class.cursor + SLAB_SIZE;
+        }
+        // slabs are cache line aligned, a block is aligned to min(size, CACHELINE_SIZE)
+        void* block = reinterpret_cast<void*>(size_class.cursor);
+        size_class.cursor += size;
+        return block;
+    }
+
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override {
+        if (bytes > MAX_OBJECT_SIZE || alignment > CACHELINE_SIZE) {
+            upstream_->deallocate(ptr, bytes, alignment);
+            return;
+        }
+        SizeClass& size_class = classes_[ClassIndex(std::max(bytes, alignment))];
+        FreeBlock* block = static_cast<FreeBlock*>(ptr);
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        block->next = size_class.free_list;
+        size_class.free_list = block;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+private:
+    static const std::size_t CLASS_NUM = 9;
+    static_assert((MIN_OBJECT_SIZE << (CLASS_NUM - 1)) == MAX_OBJECT_SIZE, "size classes must end at MAX_OBJECT_SIZE");
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct alignas(CACHELINE_SIZE) SizeClass {
+        std::mutex mutex;
+        FreeBlock* free_list = nullptr;
+        // unused part of the last slab
+        uintptr_t cursor = 0;
+        uintptr_t end = 0;
+        std::vector<void*> slabs;
+    };
+
+    // smallest class whose size is at least bytes
+    static std::size_t ClassIndex(std::size_t bytes) {
+        if (bytes <= MIN_OBJECT_SIZE) {
+            return 0;
+        }
+        return 64 - __builtin_clzll((bytes - 1) / MIN_OBJECT_SIZE);
+    }
+
+    std::pmr::memory_resource* upstream_;
+    SizeClass classes_[CLASS_NUM];
+};
+
+/**
+ * @brief Allocator bound to one concrete resource type
+ *
+ * Same role as std::pmr::polymorphic_allocator, but the resource type is known, so the
+ * calls into a final resource such as ArenaResource or SlabResource are not virtual.
+ * Usable as the Allocator parameter of the STL containers and of the hippo queues/maps.
+ *
+ * @tparam T Type of element
+ * @tparam Resource Memory resource, derived from std::pmr::memory_resource
+ */
+template <typename T, typename Resource>
+class ResourceAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <typename U>
+    struct rebind {
+        using other = ResourceAllocator<U, Resource>;
+    };
+
+    explicit ResourceAllocator(Resource* resource) : resource_(resource) {}
+    template <typename U>
+    ResourceAllocator(const ResourceAllocator<U, Resource>& other) : resource_(other.GetResource()) {}
+
+    // the resource type is final, so its do_allocate/do_deallocate are called directly
+    T* allocate(std::size_t num) { return static_cast<T*>(resource_->allocate(num * sizeof(T), alignof(T))); }
+    void deallocate(T* ptr, std::size_t num) { resource_->deallocate(ptr, num * sizeof(T), alignof(T)); }
+
+    Resource* GetResource() const { return resource_; }
+
+    template <typename U>
+    bool operator==(const ResourceAllocator<U, Resource>& other) const {
+        return resource_ == other.GetResource();
+    }
+    template <typename U>
+    bool operator!=(const ResourceAllocator<U, Resource>& other) const {
+        return resource_ != other.GetResource();
+    }
+
+private:
+    Resource* resource_;
+};
+
+NAMESPACE_COMMON_END
+NAMESPACE_HIPPO_END
+
+#endif  // !__HIPPO_MEMORY_RESOURCE_HPP__
@@ -0,0 +1,326 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_NUMA_HPP__
+#define __HIPPO_NUMA_HPP__
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "hippo_namespace.hpp"
+#include "hippo_macro.hpp"
+
+NAMESPACE_HIPPO_BEGIN
+NAMESPACE_COMMON_BEGIN
+
+/**
+ * @brief Nodes of the machine and the cpus each of them holds
+ *
+ * Detect reads the sysfs node directory, a machine or kernel without NUMA support is seen
+ * as a single node holding every cpu. The topology can also be given explicitly, or read
+ * from a copy of the sysfs tree, which lets node aware code run with several nodes on a
+ * single node machine: pinning and binding to a node the kernel does not know simply fail
+ * and the work stays where it is. Node ids may be sparse, an absent or memory only node
+ * has no cpu.
+ */
+class NumaTopology {
+public:
+    static const char *DEFAULT_NODE_DIR;
+
+    // node_cpus[node] are the cpus of node
+    explicit NumaTopology(std::vector<std::vector<int>> node_cpus) : node_cpus_(std::move(node_cpus)) {
+        if (node_cpus_.empty()) {
+            node_cpus_.emplace_back();
+        }
+        for (std::size_t node = 0; node < node_cpus_.size(); ++node) {
+            for (int cpu : node_cpus_[node]) {
+                if (cpu < 0) {
+                    continue;
+                }
+                if (static_cast<std::size_t>(cpu) >= cpu_nodes_.size()) {
+                    cpu_nodes_.resize(cpu + 1, -1);
+                }
+                cpu_nodes_[cpu] = static_cast<int>(node);
+            }
+        }
+    }
+
+    static NumaTopology Detect(const std::string &node_dir = DEFAULT_NODE_DIR) {
+        std::vector<std::vector<int>> node_cpus;
+#ifdef __linux__
+        DIR *dir = opendir(node_dir.c_str());
+        if (dir != nullptr) {
+            while (struct dirent *entry = readdir(dir)) {
+                int node = -1;
+                char tail = 0;
+                if (sscanf(entry->d_name, "node%d%c", &node, &tail) != 1 || node < 0) {
+                    continue;
+                }
+                std::ifstream file(node_dir + "/" + entry->d_name + "/cpulist");
+                std::string cpu_list;
+                std::getline(file, cpu_list);
+                if (static_cast<std::size_t>(node) >= node_cpus.size()) {
+                    node_cpus.resize(node + 1);
+                }
+                node_cpus[node] = ParseCpuList(cpu_list);
+            }
+            closedir(dir);
+        }
+#endif
+        if (node_cpus.empty()) {
+            std::vector<int> cpus;
+            for (unsigned int cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1U); ++cpu) {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+            node_cpus.push_back(std::move(cpus));
+        }
+        return NumaTopology(std::move(node_cpus));
+    }
+
+    // detected once, the topology of a running machine does not change
+    static const NumaTopology &Instance() {
+        static const NumaTopology topology = Detect();
+        return topology;
+    }
+
+    // "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+    static std::vector<int> ParseCpuList(const std::string &cpu_list) {
+        std::vector<int> cpus;
+        std::size_t pos = 0;
+        while (pos < cpu_list.size()) {
+            std::size_t end = cpu_list.find(',', pos);
+            if (end == std::string::npos) {
+                end = cpu_list.size();
+            }
+            int first = 0;
+            int last = 0;
+            int num = sscanf(cpu_list.substr(pos, end - pos).c_str(), "%d-%d", &first, &last);
+            if (num == 1) {
+                last = first;
+            }
+            if (num >= 1) {
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+            pos = end + 1;
+        }
+        return cpus;
+    }
+
+    // highest node id + 1
+    int NodeNum() const { return static_cast<int>(node_cpus_.size()); }
+
+    const std::vector<int> &CpusOfNode(int node) const {
+        static const std::vector<int> none;
+        return node >= 0 && node < NodeNum() ? node_cpus_[node] : none;
+    }
+
+    // -1 for a cpu outside the topology
+    int NodeOfCpu(int cpu) const {
+        return cpu >= 0 && static_cast<std::size_t>(cpu) < cpu_nodes_.size() ? cpu_nodes_[cpu] : -1;
+    }
+
+    // node of the cpu the calling thread runs on now, -1 if unknown
+    int CurrentNode() const {
+#ifdef __linux__
+        return NodeOfCpu(sched_getcpu());
+#else
+        return -1;
+#endif
+    }
+
+private:
+    std::vector<std::vector<int>> node_cpus_;
+    std::vector<int> cpu_nodes_;
+};
+
+inline const char *NumaTopology::DEFAULT_NODE_DIR = "/sys/devices/system/node";
+
+/**
+ * @brief Thread and memory placement through the raw syscalls
+ *
+ * No dependency on libnuma. Every call returns false when the kernel refuses, e.g. no NUMA
+ * support, a node it does not know or a container forbidding the policy, and callers go on
+ * with the default first touch placement.
+ */
+class Numa {
+public:
+    // pin the calling thread to the cpus of node
+    static bool PinThreadToNode(int node, const NumaTopology &topology = NumaTopology::Instance()) {
+        return PinThreadToCpus(topology.CpusOfNode(node));
+    }
+
+    static bool PinThreadToCpus(const std::vector<int> &cpus) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (CPU_COUNT(&set) == 0) {
+            return false;
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpus;
+        return false;
+#endif
+    }
+
+    // place the pages of [addr, addr + len) on node, addr must be page aligned, touched pages are migrated
+    static bool BindMemory(void *addr, std::size_t len, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+        std::vector<unsigned long> mask;
+        if (!NodeMask(node, &mask)) {
+            return false;
+        }
+        return syscall(SYS_mbind, addr, len, POLICY_BIND, mask.data(), mask.size() * ULONG_BITS + 1, POLICY_MOVE) == 0;
+#else
+        (void)addr;
+        (void)len;
+        (void)node;
+        return false;
+#endif
+    }
+
+    // allocations of the calling thread prefer node, node < 0 restores the default local policy
+    static bool SetPreferredNode(int node) {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+        if (node < 0) {
+            return syscall(SYS_set_mempolicy, POLICY_DEFAULT, nullptr, 0) == 0;
+        }
+        std::vector<unsigned long> mask;
+        if (!NodeMask(node, &mask)) {
+            return false;
+        }
+        return syscall(SYS_set_mempolicy, POLICY_PREFERRED, mask.data(), mask.size() * ULONG_BITS + 1) == 0;
+#else
+        (void)node;
+        return false;
+#endif
+    }
+
+private:
+    // MPOL_* values of linux/mempolicy.h, stable kernel ABI
+    static const int POLICY_DEFAULT = 0;
+    static const int POLICY_PREFERRED = 1;
+    static const int POLICY_BIND = 2;
+    static const unsigned int POLICY_MOVE = 1U << 1;
+    static const std::size_t ULONG_BITS = sizeof(unsigned long) * CHAR_BIT;
+    // the kernel rejects larger node ids anyway
+    static const int MAX_NODE = 1024;
+
+    static bool NodeMask(int node, std::vector<unsigned long> *mask) {
+        if (node < 0 || node >= MAX_NODE) {
+            return false;
+        }
+        mask->assign(node / ULONG_BITS + 1, 0);
+        (*mask)[node / ULONG_BITS] = 1UL << (node % ULONG_BITS);
+        return true;
+    }
+};
+
+// allocations of the calling thread prefer node for the lifetime of the guard
+class ScopedPreferredNode {
+public:
+    explicit ScopedPreferredNode(int node) : applied_(node >= 0 && Numa::SetPreferredNode(node)) {}
+    ~ScopedPreferredNode() {
+        if (applied_) {
+            Numa::SetPreferredNode(-1);
+        }
+    }
+    ScopedPreferredNode(const ScopedPreferredNode &other) = delete;
+    ScopedPreferredNode &operator=(const ScopedPreferredNode &other) = delete;
+
+private:
+    bool applied_;
+};
+
+/**
+ * @brief Memory resource handing out pages bound to one node
+ *
+ * Each allocation is its own page rounded mapping, so it is meant as the upstream of an
+ * ArenaResource or SlabResource, or for large buffers such as a BoundedQueue ring through
+ * std::pmr::polymorphic_allocator or ResourceAllocator. When the kernel cannot bind, the
+ * pages are ordinary first touch memory.
+ */
+class NumaResource final : public std::pmr::memory_resource {
+public:
+    explicit NumaResource(int node) : node_(node) {}
+    NumaResource(const NumaResource &other) = delete;
+    NumaResource &operator=(const NumaResource &other) = delete;
+
+    int Node() const { return node_; }
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+#ifdef __linux__
+        if (alignment <= PageSize()) {
+            const std::size_t length = RoundToPage(bytes);
+            void *ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            Numa::BindMemory(ptr, length, node_);
+            return ptr;
+        }
+#endif
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) override {
+#ifdef __linux__
+        if (alignment <= PageSize()) {
+            munmap(ptr, RoundToPage(bytes));
+            return;
+        }
+#endif
+        std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+private:
+#ifdef __linux__
+    static std::size_t PageSize() {
+        static const std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        return page_size;
+    }
+
+    static std::size_t RoundToPage(std::size_t bytes) {
+        return (std::max<std::size_t>(bytes, 1) + PageSize() - 1) / PageSize() * PageSize();
+    }
+#endif
+
+    int node_;
+};
+
+NAMESPACE_COMMON_END
+NAMESPACE_HIPPO_END
+
+#endif  // !__HIPPO_NUMA_HPP__
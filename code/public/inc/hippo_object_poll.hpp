@@ -8,98 +8,671 @@
 #define __HIPPO_OBJECT_POOL_HPP__
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <new>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "hippo_namespace.hpp"
-#include "hippo_for_each.hpp"
 #include "hippo_macro.hpp"
+#include "hippo_numa.hpp"
 
 NAMESPACE_HIPPO_BEGIN
 NAMESPACE_COMMON_BEGIN
 
+// small dense index of the calling thread, the index of an exited thread is given to the next new thread
+class ThreadSlot {
+public:
+    using ExitCallback = void (*)(void *owner, uint32_t id);
+
+    static uint32_t Id() { return LocalHolder().id; }
+
+    // callback runs when the calling thread exits if owner is still alive, before its index is reused
+    static void AtExit(std::weak_ptr<void> owner, ExitCallback callback) {
+        auto &hooks = LocalHolder().hooks;
+        hooks.erase(std::remove_if(hooks.begin(), hooks.end(), [](const Hook &hook) { return hook.owner.expired(); }),
+                    hooks.end());
+        hooks.push_back({std::move(owner), callback});
+    }
+
+private:
+    struct Hook {
+        std::weak_ptr<void> owner;
+        ExitCallback callback;
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<uint32_t> free_ids;
+        uint32_t next_id = 0;
+    };
+
+    struct Holder {
+        Holder() {
+            Registry &registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            if (registry.free_ids.empty()) {
+                id = registry.next_id++;
+            } else {
+                id = registry.free_ids.back();
+                registry.free_ids.pop_back();
+            }
+        }
+        ~Holder() {
+            for (auto &hook : hooks) {
+                if (auto owner = hook.owner.lock()) {
+                    hook.callback(owner.get(), id);
+                }
+            }
+            Registry &registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.free_ids.push_back(id);
+        }
+        uint32_t id = 0;
+        std::vector<Hook> hooks;
+    };
+
+    static Holder &LocalHolder() {
+        static thread_local Holder holder;
+        return holder;
+    }
+
+    static Registry &GetRegistry() {
+        // threads may exit after static destruction, never destroyed
+        static Registry *registry = new Registry();
+        return *registry;
+    }
+};
+
+/**
+ * @brief Object pool safe to use from any thread, fixed or growing by arena chunks
+ *
+ * Free objects are kept in magazines (Bonwick, Magazines and Vmem) of MAGAZINE_SIZE
+ * pointers. Every thread owns a loaded and a previous magazine in the pool, so most
+ * GetObject/ReleaseObject calls touch only thread local state. When both magazines of a
+ * thread run empty (or full) the thread exchanges one whole magazine with the depot,
+ * two lock-free stacks of full and empty magazines. The first MAX_CACHED_THREADS
+ * threads get their own magazines, later threads share one set behind a mutex.
+ * An exiting thread hands its objects to the shared magazines if the pool is owned by
+ * a shared_ptr. An object may be released by another thread than the one which got it.
+ * Up to 2 * MAGAZINE_SIZE free objects can sit in the magazines of each thread, the
+ * Get functions return an empty handle when all the others are in use.
+ *
+ * Objects live in arena chunks. The num_objects constructors build one chunk and every
+ * object up front, the Options constructor adds a chunk whenever the depot runs dry, up
+ * to max_objects, and may construct objects on their first acquire and back chunks with
+ * huge pages. Trim gives back to the OS the chunks whose objects are all idle in the depot.
+ *
+ * GetUnique (move-only) and GetRef (intrusive reference count) return handles which
+ * never allocate and do not pin the pool, the pool must outlive them. GetObject returns
+ * a std::shared_ptr which keeps the pool alive, at the cost of a control block
+ * allocation per call.
+ *
+ * @tparam T Type of object
+ */
 template <typename T>
 class ObjectPool : public std::enable_shared_from_this<ObjectPool<T>> {
+    struct Node;
+
 public:
     using InitFunc = std::function<void(T *)>;
     using ObjectPoolPtr = std::shared_ptr<ObjectPool<T>>;
 
-    template <typename... Args>
-    explicit ObjectPool(uint32_t num_objects, Args &&... args) : num_objects_(num_objects) {
-        const size_t size = sizeof(Node);
-        object_arena_ = static_cast<char *>(std::calloc(num_objects_, size));
-        if (object_arena_ == nullptr) {
-            throw std::bad_alloc();
+    struct Options {
+        // rounded up to a multiple of MAGAZINE_SIZE
+        uint32_t chunk_objects = 1024;
+        // growth cap, rounded up to whole chunks
+        uint32_t max_objects = 1U << 20;
+        // construct an object on its first acquire instead of when its chunk is allocated
+        bool lazy_construct = true;
+        // mmap chunks with MAP_HUGETLB, transparent huge pages if none are reserved
+        bool huge_page = false;
+        // mmap chunks bound to this NUMA node, -1 leaves them to first touch
+        int numa_node = -1;
+        // run after each object is constructed
+        InitFunc init;
+    };
+
+    // returns the object to its pool
+    struct Deleter {
+        void operator()(T *object) const { pool->ReleaseObject(object); }
+        ObjectPool *pool = nullptr;
+    };
+    using UniquePtr = std::unique_ptr<T, Deleter>;
+
+    // copyable handle counting references inside the pooled object, the last one returns it
+    class RefPtr {
+    public:
+        RefPtr() = default;
+        RefPtr(const RefPtr &other) : pool_(other.pool_), node_(other.node_) {
+            if (node_ != nullptr) {
+                node_->ref_num.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        RefPtr(RefPtr &&other) noexcept : pool_(other.pool_), node_(other.node_) {
+            other.pool_ = nullptr;
+            other.node_ = nullptr;
         }
+        RefPtr &operator=(RefPtr other) noexcept {
+            std::swap(pool_, other.pool_);
+            std::swap(node_, other.node_);
+            return *this;
+        }
+        ~RefPtr() { Reset(); }
 
-        FOR_EACH(i, 0, num_objects_) {
-            T *obj = new (object_arena_ + i * size) T(std::forward<Args>(args)...);
-            reinterpret_cast<Node *>(obj)->next = free_head_;
-            free_head_ = reinterpret_cast<Node *>(obj);
+        void Reset() {
+            // acq_rel, every use through the other handles happens before the object is reused
+            if (node_ != nullptr && node_->ref_num.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                pool_->ReleaseObject(node_->Object());
+            }
+            pool_ = nullptr;
+            node_ = nullptr;
         }
-    }
+
+        T *Get() const { return node_ != nullptr ? node_->Object() : nullptr; }
+        T &operator*() const { return *node_->Object(); }
+        T *operator->() const { return node_->Object(); }
+        explicit operator bool() const { return node_ != nullptr; }
+        uint32_t UseCount() const { return node_ != nullptr ? node_->ref_num.load(std::memory_order_relaxed) : 0; }
+
+    private:
+        friend class ObjectPool;
+        RefPtr(ObjectPool *pool, T *object) : pool_(pool), node_(reinterpret_cast<Node *>(object)) {
+            node_->ref_num.store(1, std::memory_order_relaxed);
+        }
+
+        ObjectPool *pool_ = nullptr;
+        Node *node_ = nullptr;
+    };
+
+    static const uint32_t MAGAZINE_SIZE = 16;
+    static const uint32_t MAX_CACHED_THREADS = 64;
+    static const uint32_t MAX_CHUNK_NUM = 4096;
 
     template <typename... Args>
-    ObjectPool(uint32_t num_objects, InitFunc f, Args &&... args) : num_objects_(num_objects) {
-        const size_t size = sizeof(Node);
-        object_arena_ = static_cast<char *>(std::calloc(num_objects_, size));
-        if (object_arena_ == nullptr) {
+    explicit ObjectPool(uint32_t num_objects, Args &&... args) : ObjectPool(num_objects, InitFunc(), args...) {}
+
+    template <typename... Args>
+    ObjectPool(uint32_t num_objects, InitFunc f, Args &&... args)
+        : chunk_objects_(num_objects), max_objects_(num_objects), lazy_construct_(false) {
+        SetConstructor(std::move(f), std::forward<Args>(args)...);
+        Init();
+        if (num_objects > 0 && !Grow()) {
             throw std::bad_alloc();
         }
+    }
 
-        FOR_EACH(i, 0, num_objects_) {
-            T *obj = new (object_arena_ + i * size) T(std::forward<Args>(args)...);
-            f(obj);
-            reinterpret_cast<Node *>(obj)->next = free_head_;
-            free_head_ = reinterpret_cast<Node *>(obj);
-        }
+    template <typename... Args>
+    explicit ObjectPool(const Options &options, Args &&... args)
+        : chunk_objects_(options.chunk_objects),
+          max_objects_(options.max_objects),
+          lazy_construct_(options.lazy_construct),
+          huge_page_(options.huge_page),
+          numa_node_(options.numa_node) {
+        // large caps take larger chunks, the chunk table stays small
+        chunk_objects_ =
+            std::max(chunk_objects_, static_cast<uint32_t>((max_objects_ + MAX_CHUNK_NUM - 1ULL) / MAX_CHUNK_NUM));
+        // whole magazines per chunk keep partial magazines out of the depot, see Init
+        chunk_objects_ = (std::max(chunk_objects_, 1U) + MAGAZINE_SIZE - 1) / MAGAZINE_SIZE * MAGAZINE_SIZE;
+        SetConstructor(options.init, std::forward<Args>(args)...);
+        Init();
     }
 
     virtual ~ObjectPool() {
-        if (object_arena_ != nullptr) {
-            const size_t size = sizeof(Node);
-            FOR_EACH(i, 0, num_objects_) { reinterpret_cast<Node *>(object_arena_ + i * size)->object.~T(); }
-            std::free(object_arena_);
+        for (uint32_t i = 0; i < chunk_num_; ++i) {
+            FreeChunk(i);
+        }
+    }
+
+    UniquePtr GetUnique() { return UniquePtr(AcquireObject(), Deleter{this}); }
+
+    RefPtr GetRef() {
+        T *object = AcquireObject();
+        if (hippo_unlikely(object == nullptr)) {
+            return RefPtr();
         }
+        return RefPtr(this, object);
     }
 
+    // keeps the pool alive while the object is in use
     std::shared_ptr<T> GetObject() {
-        if (hippo_unlikely(free_head_ == nullptr)) {
+        T *object = AcquireObject();
+        if (hippo_unlikely(object == nullptr)) {
             return nullptr;
         }
 
         auto self = this->shared_from_this();
-        auto obj =
-            std::shared_ptr<T>(reinterpret_cast<T *>(free_head_), [self](T *object) { self->ReleaseObject(object); });
-        free_head_ = free_head_->next;
-        return obj;
+        return std::shared_ptr<T>(object, [self](T *object) { self->ReleaseObject(object); });
+    }
+
+    // number of objects in the allocated chunks
+    uint64_t Capacity() { return capacity_.load(std::memory_order_relaxed); }
+
+    // free the chunks whose objects are all idle in the depot, return the number of objects freed.
+    // Get calls running meanwhile may miss the objects Trim holds and fail
+    uint32_t Trim() {
+        std::lock_guard<std::mutex> lock(grow_mutex_);
+        std::vector<Magazine *> magazines;
+        uint32_t index = 0;
+        while (full_.Pop(this, &index)) {
+            magazines.push_back(GetMagazine(index));
+        }
+
+        // chunks sorted by address, to find the chunk of an object
+        std::vector<std::pair<const Node *, uint32_t>> ranges;
+        for (uint32_t i = 0; i < chunk_num_; ++i) {
+            if (chunks_[i].nodes != nullptr) {
+                ranges.emplace_back(chunks_[i].nodes, i);
+            }
+        }
+        std::sort(ranges.begin(), ranges.end());
+        auto chunk_of = [&ranges](const T *object) {
+            auto node = reinterpret_cast<const Node *>(object);
+            auto ite = std::upper_bound(ranges.begin(), ranges.end(), node,
+                                        [](const Node *node, const auto &range) { return node < range.first; });
+            return (ite - 1)->second;
+        };
+
+        std::vector<uint32_t> idle_num(chunk_num_, 0);
+        for (Magazine *magazine : magazines) {
+            for (uint32_t i = 0; i < magazine->count; ++i) {
+                ++idle_num[chunk_of(magazine->objects[i])];
+            }
+        }
+        std::vector<T *> kept;
+        for (Magazine *magazine : magazines) {
+            for (uint32_t i = 0; i < magazine->count; ++i) {
+                if (idle_num[chunk_of(magazine->objects[i])] != chunk_objects_) {
+                    kept.push_back(magazine->objects[i]);
+                }
+            }
+            magazine->count = 0;
+        }
+        uint32_t freed_num = 0;
+        for (uint32_t i = 0; i < chunk_num_; ++i) {
+            if (idle_num[i] == chunk_objects_) {
+                FreeChunk(i);
+                freed_num += chunk_objects_;
+            }
+        }
+
+        // refill the magazines with the objects left, at most the last one is partial
+        std::size_t next = 0;
+        for (Magazine *magazine : magazines) {
+            while (magazine->count < MAGAZINE_SIZE && next < kept.size()) {
+                magazine->objects[magazine->count++] = kept[next++];
+            }
+            if (magazine->count == MAGAZINE_SIZE) {
+                full_.Push(magazine);
+                continue;
+            }
+            if (magazine->count > 0) {
+                // only whole magazines may enter the depot
+                std::lock_guard<std::mutex> shared_lock(shared_mutex_);
+                while (magazine->count > 0) {
+                    ReleaseObject(&caches_[MAX_CACHED_THREADS], magazine->objects[--magazine->count]);
+                }
+            }
+            empty_.Push(magazine);
+        }
+        return freed_num;
     }
 
 private:
     struct Node {
-        T object;
-        Node *next;
+        // memory of a new chunk is zeroed, which is a valid node with no object constructed yet
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        // used by RefPtr only
+        std::atomic<uint32_t> ref_num;
+        bool constructed;
+
+        T *Object() { return reinterpret_cast<T *>(&storage); }
+    };
+
+    struct Chunk {
+        Node *nodes = nullptr;
+        // size of the mapping, 0 if allocated with calloc
+        std::size_t mapped_bytes = 0;
+    };
+
+    struct Magazine {
+        // index + 1 of the next magazine in a depot stack
+        std::atomic<uint32_t> next = {0};
+        uint32_t index = 0;
+        uint32_t count = 0;
+        T *objects[MAGAZINE_SIZE];
+    };
+
+    struct alignas(CACHELINE_SIZE) LocalCache {
+        Magazine *loaded = nullptr;
+        Magazine *previous = nullptr;
+        // the owner thread flushes the magazines when it exits
+        bool registered = false;
+    };
+
+    // Treiber stack of magazine indexes, the head carries a tag against ABA
+    class MagazineStack {
+    public:
+        void Push(Magazine *magazine) {
+            uint64_t head = head_.load(std::memory_order_relaxed);
+            uint64_t desired = 0;
+            do {
+                magazine->next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+                desired = (((head >> 32) + 1) << 32) | (magazine->index + 1);
+            } while (!head_.compare_exchange_weak(head, desired, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        // return false when the stack is empty
+        bool Pop(ObjectPool *pool, uint32_t *index) {
+            uint64_t head = head_.load(std::memory_order_acquire);
+            uint64_t desired = 0;
+            do {
+                if (static_cast<uint32_t>(head) == 0) {
+                    return false;
+                }
+                // may read a magazine popped and pushed again meanwhile, the tag fails the CAS then
+                Magazine *top = pool->GetMagazine(static_cast<uint32_t>(head) - 1);
+                desired = (((head >> 32) + 1) << 32) | top->next.load(std::memory_order_relaxed);
+            } while (!head_.compare_exchange_weak(head, desired, std::memory_order_acquire, std::memory_order_acquire));
+            *index = static_cast<uint32_t>(head) - 1;
+            return true;
+        }
+
+        bool Empty() { return static_cast<uint32_t>(head_.load(std::memory_order_acquire)) == 0; }
+
+    private:
+        alignas(CACHELINE_SIZE) std::atomic<uint64_t> head_ = {0};
     };
 
     ObjectPool(ObjectPool &) = delete;
     ObjectPool &operator=(ObjectPool &) = delete;
-    void ReleaseObject(T *) {
+
+    template <typename... Args>
+    void SetConstructor(InitFunc init, Args &&... args) {
+        // arguments are copied once, every object is constructed from the same values
+        construct_ = [init = std::move(init), params = std::make_tuple(std::forward<Args>(args)...)](Node *node) {
+            T *object = std::apply([node](const auto &... args) { return new (&node->storage) T(args...); }, params);
+            if (init) {
+                init(object);
+            }
+        };
+    }
+
+    // A magazine out of the empty stack is either in a local cache or full in the depot, with
+    // one more magazine than that a thread whose magazines are both full always finds an empty one.
+    // The base magazines cover the caches, every chunk slot brings the magazines for its objects
+    void Init() {
+        const uint32_t cache_num = MAX_CACHED_THREADS + 1;
+        chunk_num_ =
+            chunk_objects_ == 0 ? 0 : static_cast<uint32_t>((max_objects_ + chunk_objects_ - 1ULL) / chunk_objects_);
+        chunk_magazine_num_ = (chunk_objects_ + MAGAZINE_SIZE - 1) / MAGAZINE_SIZE;
+        base_magazine_num_ = 2 * cache_num + 1;
+        max_capacity_ = static_cast<uint64_t>(chunk_num_) * chunk_objects_;
+        chunks_.reset(new Chunk[chunk_num_]);
+        chunk_magazines_.reset(new std::unique_ptr<Magazine[]>[chunk_num_]);
+        base_magazines_.reset(new Magazine[base_magazine_num_]);
+        caches_.reset(new LocalCache[cache_num]);
+
+        uint32_t index = 0;
+        for (; index < base_magazine_num_; ++index) {
+            base_magazines_[index].index = index;
+        }
+        for (uint32_t i = 0; i < cache_num; ++i) {
+            caches_[i].loaded = &base_magazines_[2 * i];
+            caches_[i].previous = &base_magazines_[2 * i + 1];
+        }
+        empty_.Push(&base_magazines_[base_magazine_num_ - 1]);
+    }
+
+    // chunk magazines are never freed, a stale index read by Pop stays valid
+    Magazine *GetMagazine(uint32_t index) {
+        if (index < base_magazine_num_) {
+            return &base_magazines_[index];
+        }
+        index -= base_magazine_num_;
+        return &chunk_magazines_[index / chunk_magazine_num_][index % chunk_magazine_num_];
+    }
+
+    Node *AllocateChunk(Chunk *chunk) {
+        std::size_t bytes = static_cast<std::size_t>(chunk_objects_) * sizeof(Node);
+#ifdef __linux__
+        if (huge_page_ || numa_node_ >= 0) {
+            const std::size_t page_size = huge_page_ ? HUGE_PAGE_SIZE : static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+            bytes = (bytes + page_size - 1) / page_size * page_size;
+            void *ptr = MAP_FAILED;
+            if (huge_page_) {
+                ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            }
+            if (ptr == MAP_FAILED) {
+                ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (ptr == MAP_FAILED) {
+                    return nullptr;
+                }
+                if (huge_page_) {
+                    // no huge page reserved, ask for transparent huge pages
+                    madvise(ptr, bytes, MADV_HUGEPAGE);
+                }
+            }
+            if (numa_node_ >= 0) {
+                // before any page is touched, even an eager chunk is constructed on the node
+                Numa::BindMemory(ptr, bytes, numa_node_);
+            }
+            chunk->mapped_bytes = bytes;
+            chunk->nodes = static_cast<Node *>(ptr);
+            return chunk->nodes;
+        }
+#endif
+        // calloc leaves the pages of a large chunk untouched until used
+        chunk->mapped_bytes = 0;
+        chunk->nodes = static_cast<Node *>(std::calloc(chunk_objects_, sizeof(Node)));
+        return chunk->nodes;
+    }
+
+    // caller holds grow_mutex_ or is the destructor
+    void FreeChunk(uint32_t slot) {
+        Chunk &chunk = chunks_[slot];
+        if (chunk.nodes == nullptr) {
+            return;
+        }
+        for (uint32_t i = 0; i < chunk_objects_; ++i) {
+            if (chunk.nodes[i].constructed) {
+                chunk.nodes[i].Object()->~T();
+            }
+        }
+#ifdef __linux__
+        if (chunk.mapped_bytes > 0) {
+            munmap(chunk.nodes, chunk.mapped_bytes);
+        } else {
+            std::free(chunk.nodes);
+        }
+#else
+        std::free(chunk.nodes);
+#endif
+        chunk = Chunk();
+        capacity_.fetch_sub(chunk_objects_, std::memory_order_relaxed);
+    }
+
+    // add a chunk of free objects to the depot, return false at the growth cap or when out of memory
+    bool Grow() {
+        std::lock_guard<std::mutex> lock(grow_mutex_);
+        if (!full_.Empty()) {
+            // another thread has grown the pool meanwhile
+            return true;
+        }
+        uint32_t slot = 0;
+        while (slot < chunk_num_ && chunks_[slot].nodes != nullptr) {
+            ++slot;
+        }
+        if (slot == chunk_num_) {
+            return false;
+        }
+        Chunk *chunk = &chunks_[slot];
+        if (AllocateChunk(chunk) == nullptr) {
+            return false;
+        }
+        if (chunk_magazines_[slot] == nullptr) {
+            chunk_magazines_[slot].reset(new Magazine[chunk_magazine_num_]);
+            for (uint32_t i = 0; i < chunk_magazine_num_; ++i) {
+                chunk_magazines_[slot][i].index = base_magazine_num_ + slot * chunk_magazine_num_ + i;
+                empty_.Push(&chunk_magazines_[slot][i]);
+            }
+        }
+        if (!lazy_construct_) {
+            for (uint32_t i = 0; i < chunk_objects_; ++i) {
+                construct_(&chunk->nodes[i]);
+                chunk->nodes[i].constructed = true;
+            }
+        }
+        for (uint32_t i = 0; i < chunk_objects_; i += MAGAZINE_SIZE) {
+            uint32_t index = 0;
+            // cannot fail, see Init
+            empty_.Pop(this, &index);
+            Magazine *magazine = GetMagazine(index);
+            for (uint32_t j = i; j < std::min(i + MAGAZINE_SIZE, chunk_objects_); ++j) {
+                magazine->objects[magazine->count++] = chunk->nodes[j].Object();
+            }
+            full_.Push(magazine);
+        }
+        capacity_.fetch_add(chunk_objects_, std::memory_order_relaxed);
+        return true;
+    }
+
+    LocalCache *ThreadCache(uint32_t id) {
+        LocalCache *cache = &caches_[id];
+        if (hippo_unlikely(!cache->registered)) {
+            cache->registered = true;
+            ThreadSlot::AtExit(this->weak_from_this(),
+                               [](void *pool, uint32_t id) { static_cast<ObjectPool *>(pool)->FlushCache(id); });
+        }
+        return cache;
+    }
+
+    // hand the objects of an exiting thread to the shared magazines, the next thread with this id starts empty
+    void FlushCache(uint32_t id) {
+        LocalCache *cache = &caches_[id];
+        std::lock_guard<std::mutex> lock(shared_mutex_);
+        for (Magazine *magazine : {cache->loaded, cache->previous}) {
+            while (magazine->count > 0) {
+                ReleaseObject(&caches_[MAX_CACHED_THREADS], magazine->objects[--magazine->count]);
+            }
+        }
+        cache->registered = false;
+    }
+
+    T *AcquireObject() {
+        T *object = TryAcquireObject();
+        while (hippo_unlikely(object == nullptr)) {
+            // every chunk slot is in use, don't queue on grow_mutex_
+            if (capacity_.load(std::memory_order_relaxed) == max_capacity_ || !Grow()) {
+                return nullptr;
+            }
+            object = TryAcquireObject();
+        }
+        Node *node = reinterpret_cast<Node *>(object);
+        if (hippo_unlikely(!node->constructed)) {
+            construct_(node);
+            node->constructed = true;
+        }
+        return object;
+    }
+
+    T *TryAcquireObject() {
+        const uint32_t id = ThreadSlot::Id();
+        if (hippo_likely(id < MAX_CACHED_THREADS)) {
+            T *object = AcquireObject(ThreadCache(id));
+            if (hippo_likely(object != nullptr)) {
+                return object;
+            }
+        }
+        // the shared magazines also hold what exited threads flushed
+        std::lock_guard<std::mutex> lock(shared_mutex_);
+        return AcquireObject(&caches_[MAX_CACHED_THREADS]);
+    }
+
+    T *AcquireObject(LocalCache *cache) {
+        if (hippo_unlikely(cache->loaded->count == 0)) {
+            if (cache->previous->count > 0) {
+                std::swap(cache->loaded, cache->previous);
+            } else {
+                uint32_t index = 0;
+                if (!full_.Pop(this, &index)) {
+                    // every free object sits in the magazines of other threads
+                    return nullptr;
+                }
+                empty_.Push(cache->loaded);
+                cache->loaded = GetMagazine(index);
+            }
+        }
+        Magazine *magazine = cache->loaded;
+        return magazine->objects[--magazine->count];
+    }
+
+    void ReleaseObject(T *object) {
         if (hippo_unlikely(object == nullptr)) {
             return;
         }
 
-        reinterpret_cast<Node *>(object)->next = free_head_;
-        free_head_ = reinterpret_cast<Node *>(object);
+        const uint32_t id = ThreadSlot::Id();
+        if (hippo_likely(id < MAX_CACHED_THREADS)) {
+            ReleaseObject(ThreadCache(id), object);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(shared_mutex_);
+        ReleaseObject(&caches_[MAX_CACHED_THREADS], object);
+    }
+
+    void ReleaseObject(LocalCache *cache, T *object) {
+        if (hippo_unlikely(cache->loaded->count == MAGAZINE_SIZE)) {
+            if (cache->previous->count < MAGAZINE_SIZE) {
+                std::swap(cache->loaded, cache->previous);
+            } else {
+                uint32_t index = 0;
+                // cannot fail, see Init
+                empty_.Pop(this, &index);
+                full_.Push(cache->previous);
+                cache->previous = cache->loaded;
+                cache->loaded = GetMagazine(index);
+            }
+        }
+        Magazine *magazine = cache->loaded;
+        magazine->objects[magazine->count++] = object;
     }
 
-    uint32_t num_objects_ = 0U;
-    char *object_arena_ = nullptr;
-    Node *free_head_ = nullptr;
+    static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    uint32_t chunk_objects_ = 0U;
+    uint32_t max_objects_ = 0U;
+    bool lazy_construct_ = false;
+    bool huge_page_ = false;
+    int numa_node_ = -1;
+    std::function<void(Node *)> construct_;
+    uint32_t chunk_num_ = 0U;
+    uint32_t chunk_magazine_num_ = 0U;
+    uint32_t base_magazine_num_ = 0U;
+    uint64_t max_capacity_ = 0U;
+    std::unique_ptr<Chunk[]> chunks_;
+    std::unique_ptr<std::unique_ptr<Magazine[]>[]> chunk_magazines_;
+    std::unique_ptr<Magazine[]> base_magazines_;
+    std::unique_ptr<LocalCache[]> caches_;
+    alignas(CACHELINE_SIZE) std::atomic<uint64_t> capacity_ = {0};
+    MagazineStack full_;
+    MagazineStack empty_;
+    std::mutex shared_mutex_;
+    std::mutex grow_mutex_;
 };
 
 NAMESPACE_COMMON_END
@@ -0,0 +1,283 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_POLICY_BOUNDED_QUEUE_HPP__
+#define __HIPPO_POLICY_BOUNDED_QUEUE_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "hippo_namespace.hpp"
+#include "hippo_macro.hpp"
+#include "hippo_wati_strategy.hpp"
+
+NAMESPACE_HIPPO_BEGIN
+NAMESPACE_COMMON_BEGIN
+
+struct SpscPolicy {
+    static constexpr bool MULTI_PRODUCER = false;
+    static constexpr bool MULTI_CONSUMER = false;
+};
+
+struct MpscPolicy {
+    static constexpr bool MULTI_PRODUCER = true;
+    static constexpr bool MULTI_CONSUMER = false;
+};
+
+struct SpmcPolicy {
+    static constexpr bool MULTI_PRODUCER = false;
+    static constexpr bool MULTI_CONSUMER = true;
+};
+
+/**
+ * @brief Bounded queue specialized for a fixed number of producers/consumers
+ *
+ * Same interface as BoundedQueue, so call sites can switch by changing a type alias.
+ * SPSC is a Lamport ring, each side only reloads the remote index when its cached copy
+ * says the ring is full/empty. MPSC/SPMC keep a sequence number per slot, so the single
+ * side never does a CAS and the multi side never waits for another thread to publish.
+ * Capacity is rounded up to a power of two.
+ *
+ * @tparam T Type of element
+ * @tparam Policy SpscPolicy, MpscPolicy or SpmcPolicy, use BoundedQueue for MPMC
+ */
+template <typename T, typename Policy>
+class PolicyBoundedQueue {
+    static_assert(!(Policy::MULTI_PRODUCER && Policy::MULTI_CONSUMER), "use BoundedQueue for MPMC");
+
+public:
+    using value_type = T;
+    using size_type = uint64_t;
+
+public:
+    PolicyBoundedQueue() {}
+    PolicyBoundedQueue& operator=(const PolicyBoundedQueue& other) = delete;
+    PolicyBoundedQueue(const PolicyBoundedQueue& other) = delete;
+    ~PolicyBoundedQueue() {
+        if (wait_strategy_) {
+            BreakAllWait();
+        }
+        if (pool_) {
+            for (uint64_t i = 0; i < capacity_; ++i) {
+                pool_[i].~Slot();
+            }
+            std::free(pool_);
+        }
+    }
+    bool Init(uint64_t size) { return Init(size, new SleepWaitStrategy()); }
+    bool Init(uint64_t size, WaitStrategy* strategy) {
+        capacity_ = 2;
+        while (capacity_ < size) {
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+        pool_ = reinterpret_cast<Slot*>(std::calloc(capacity_, sizeof(Slot)));
+        if (pool_ == nullptr) {
+            return false;
+        }
+        for (uint64_t i = 0; i < capacity_; ++i) {
+            new (&(pool_[i])) Slot(i);
+        }
+        wait_strategy_.reset(strategy);
+        return true;
+    }
+    bool Enqueue(const T& element) { return EnqueueImpl(element); }
+    bool Enqueue(T&& element) { return EnqueueImpl(std::move(element)); }
+    bool WaitEnqueue(const T& element) {
+        while (!break_all_wait_) {
+            if (Enqueue(element)) {
+                return true;
+            }
+            if (wait_strategy_->EmptyWait()) {
+                continue;
+            }
+            // wait timeout
+            break;
+        }
+
+        return false;
+    }
+    bool WaitEnqueue(T&& element) {
+        while (!break_all_wait_) {
+            if (Enqueue(std::move(element))) {
+                return true;
+            }
+            if (wait_strategy_->EmptyWait()) {
+                continue;
+            }
+            // wait timeout
+            break;
+        }
+
+        return false;
+    }
+    bool Dequeue(T* element) {
+        if constexpr (Policy::MULTI_CONSUMER) {
+            uint64_t pos = head_.load(std::memory_order_relaxed);
+            Slot* slot = nullptr;
+            while (true) {
+                slot = &pool_[pos & mask_];
+                int64_t diff = static_cast<int64_t>(slot->seq.load(std::memory_order_acquire) - (pos + 1));
+                if (diff == 0) {
+                    if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = head_.load(std::memory_order_relaxed);
+                }
+            }
+            *element = std::move(slot->data);
+            slot->seq.store(pos + capacity_, std::memory_order_release);
+        } else if constexpr (Policy::MULTI_PRODUCER) {
+            uint64_t pos = head_.load(std::memory_order_relaxed);
+            Slot* slot = &pool_[pos & mask_];
+            if (slot->seq.load(std::memory_order_acquire) != pos + 1) {
+                return false;
+            }
+            *element = std::move(slot->data);
+            slot->seq.store(pos + capacity_, std::memory_order_release);
+            head_.store(pos + 1, std::memory_order_relaxed);
+        } else {
+            uint64_t pos = head_.load(std::memory_order_relaxed);
+            if (pos == tail_cache_) {
+                tail_cache_ = tail_.load(std::memory_order_acquire);
+                if (pos == tail_cache_) {
+                    return false;
+                }
+            }
+            *element = std::move(pool_[pos & mask_].data);
+            head_.store(pos + 1, std::memory_order_release);
+        }
+        return true;
+    }
+    bool WaitDequeue(T* element) {
+        while (!break_all_wait_) {
+            if (Dequeue(element)) {
+                return true;
+            }
+            uint64_t key = wait_strategy_->PrepareWait();
+            if (Dequeue(element)) {
+                wait_strategy_->CancelWait();
+                return true;
+            }
+            if (wait_strategy_->EmptyWait(key)) {
+                continue;
+            }
+            // wait timeout
+            break;
+        }
+
+        return false;
+    }
+    uint64_t Size() {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t tail = tail_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+    bool Empty() { return Size() == 0; }
+    uint64_t Capacity() { return capacity_; }
+    void SetWaitStrategy(WaitStrategy* strategy) { wait_strategy_.reset(strategy); }
+    void BreakAllWait() {
+        break_all_wait_ = true;
+        wait_strategy_->BreakAllWait();
+    }
+    uint64_t Head() { return head_.load(); }
+    uint64_t Tail() { return tail_.load(); }
+
+private:
+    // MPSC/SPMC slot, seq tells the single side whether the slot is published or free
+    struct SequencedSlot {
+        explicit SequencedSlot(uint64_t index) : seq(index) {}
+        std::atomic<uint64_t> seq;
+        T data;
+    };
+
+    // SPSC slot, head_ and tail_ alone order the two sides
+    struct PlainSlot {
+        explicit PlainSlot(uint64_t /* index */) {}
+        T data;
+    };
+
+    using Slot = typename std::conditional<Policy::MULTI_PRODUCER || Policy::MULTI_CONSUMER, SequencedSlot,
+                                           PlainSlot>::type;
+
+    template <typename U>
+    bool EnqueueImpl(U&& element) {
+        if constexpr (Policy::MULTI_PRODUCER) {
+            uint64_t pos = tail_.load(std::memory_order_relaxed);
+            Slot* slot = nullptr;
+            while (true) {
+                slot = &pool_[pos & mask_];
+                int64_t diff = static_cast<int64_t>(slot->seq.load(std::memory_order_acquire) - pos);
+                if (diff == 0) {
+                    if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = tail_.load(std::memory_order_relaxed);
+                }
+            }
+            slot->data = std::forward<U>(element);
+            slot->seq.store(pos + 1, std::memory_order_release);
+        } else if constexpr (Policy::MULTI_CONSUMER) {
+            uint64_t pos = tail_.load(std::memory_order_relaxed);
+            Slot* slot = &pool_[pos & mask_];
+            if (slot->seq.load(std::memory_order_acquire) != pos) {
+                return false;
+            }
+            slot->data = std::forward<U>(element);
+            slot->seq.store(pos + 1, std::memory_order_release);
+            tail_.store(pos + 1, std::memory_order_relaxed);
+        } else {
+            uint64_t pos = tail_.load(std::memory_order_relaxed);
+            if (pos - head_cache_ >= capacity_) {
+                head_cache_ = head_.load(std::memory_order_acquire);
+                if (pos - head_cache_ >= capacity_) {
+                    return false;
+                }
+            }
+            pool_[pos & mask_].data = std::forward<U>(element);
+            tail_.store(pos + 1, std::memory_order_release);
+        }
+        wait_strategy_->NotifyOne();
+        return true;
+    }
+
+    // producer side
+    alignas(CACHELINE_SIZE) std::atomic<uint64_t> tail_ = {0};
+    uint64_t head_cache_ = 0;
+    // consumer side
+    alignas(CACHELINE_SIZE) std::atomic<uint64_t> head_ = {0};
+    uint64_t tail_cache_ = 0;
+    alignas(CACHELINE_SIZE) uint64_t capacity_ = 0;
+    uint64_t mask_ = 0;
+    Slot* pool_ = nullptr;
+    std::unique_ptr<WaitStrategy> wait_strategy_ = nullptr;
+    volatile bool break_all_wait_ = false;
+};
+
+template <typename T>
+using SpscBoundedQueue = PolicyBoundedQueue<T, SpscPolicy>;
+
+template <typename T>
+using MpscBoundedQueue = PolicyBoundedQueue<T, MpscPolicy>;
+
+template <typename T>
+using SpmcBoundedQueue = PolicyBoundedQueue<T, SpmcPolicy>;
+
+NAMESPACE_COMMON_END
+NAMESPACE_HIPPO_END
+
+#endif  // !__HIPPO_POLICY_BOUNDED_QUEUE_HPP__
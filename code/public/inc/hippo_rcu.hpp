@@ -0,0 +1,91 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_RCU_HPP__
+#define __HIPPO_RCU_HPP__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "hippo_namespace.hpp"
+#include "hippo_epoch_reclaimer.hpp"
+#include "hippo_lock_guard.hpp"
+
+NAMESPACE_HIPPO_BEGIN
+NAMESPACE_COMMON_BEGIN
+
+/**
+ * @brief Read-copy-update holder of a read-mostly object
+ *
+ * Readers pin the epoch and load the current version, no shared cache line is written.
+ * Writers are serialized, they copy the current version, modify the copy and publish it
+ * with one atomic exchange, a throwing update publishes nothing. The old version is
+ * retired to the EpochDomain and deleted once every reader which could see it has left.
+ *
+ *     {
+ *         ReadLockGuard<RcuSnapshot<Table>> guard(table);
+ *         const Table* snapshot = table.Get();
+ *         ...
+ *     }
+ *     table.Update([](Table* copy) { copy->Add(route); });
+ *
+ * @tparam T Type of object, must be copy constructible
+ */
+template <typename T>
+class RcuSnapshot {
+    friend class ReadLockGuard<RcuSnapshot<T>>;
+    friend class WriteLockGuard<RcuSnapshot<T>>;
+
+public:
+    RcuSnapshot() : current_(new T()) {}
+    // takes the ownership of value
+    explicit RcuSnapshot(T* value) : current_(value) {}
+    RcuSnapshot(const RcuSnapshot& other) = delete;
+    RcuSnapshot& operator=(const RcuSnapshot& other) = delete;
+    ~RcuSnapshot() { delete current_.load(std::memory_order_acquire); }
+
+    // only valid while a ReadLockGuard (or an EpochGuard) is held
+    const T* Get() const { return current_.load(std::memory_order_acquire); }
+
+    // copy, modify and publish under the write lock
+    template <typename F>
+    void Update(F&& f) {
+        WriteLockGuard<RcuSnapshot<T>> guard(*this);
+        // freed if f throws, the current version is left untouched
+        std::unique_ptr<T> copy(Copy());
+        std::forward<F>(f)(copy.get());
+        Publish(copy.release());
+    }
+
+    // copy of the current version for a writer holding a WriteLockGuard
+    T* Copy() const { return new T(*current_.load(std::memory_order_acquire)); }
+
+    // takes the ownership of value, concurrent publishers without the write lock may lose updates
+    void Publish(T* value) {
+        T* old_value = current_.exchange(value, std::memory_order_acq_rel);
+        auto& domain = EpochDomain::Instance();
+        domain.Retire(old_value);
+        // writes are rare, do not wait for the retire threshold to free old versions
+        domain.Reclaim();
+    }
+
+private:
+    // all these function only can used by ReadLockGuard/WriteLockGuard;
+    void ReadLock() { EpochDomain::Instance().Enter(); }
+    void ReadUnlock() { EpochDomain::Instance().Exit(); }
+    void WriteLock() { write_mutex_.lock(); }
+    void WriteUnlock() { write_mutex_.unlock(); }
+
+    std::atomic<T*> current_;
+    std::mutex write_mutex_;
+};
+
+NAMESPACE_COMMON_END
+NAMESPACE_HIPPO_END
+
+#endif  // !__HIPPO_RCU_HPP__
@@ -7,23 +7,34 @@
 #ifndef __HIPPO_RW_LOCK_HPP__
 #define __HIPPO_RW_LOCK_HPP__
 
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <atomic>
+#include <chrono>
+#include <climits>
 #include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
+#include <ctime>
 #include <iostream>
 #include <mutex>
 #include <thread>
 
 #include "hippo_namespace.hpp"
+#include "hippo_lock_guard.hpp"
+#include "hippo_macro.hpp"
 
 NAMESPACE_HIPPO_BEGIN
 NAMESPACE_COMMON_BEGIN
 
+template <typename RWLock>
+class ReaderBiasedRWLock;
+
 class AtomicRWLock {
     friend class ReadLockGuard<AtomicRWLock>;
     friend class WriteLockGuard<AtomicRWLock>;
+    friend class ReaderBiasedRWLock<AtomicRWLock>;
 
 public:
     static const int32_t RW_LOCK_FREE = 0;
@@ -90,6 +101,455 @@ private:
     bool write_first_ = true;
 };
 
+/**
+ * @brief Phase fair RW lock which parks its waiters on a futex
+ *
+ * Lock and unlock are one CAS or atomic add while uncontended. A waiter spins SPIN_NUM
+ * times, then yields YIELD_NUM times, then sleeps on a futex, so a long write does not
+ * keep readers on the cpu. The phases alternate: once a writer waits, new readers queue
+ * behind it, and when a writer unlocks, the readers which queued meanwhile are all
+ * admitted before the next writer, so neither side starves.
+ *
+ * An upgradeable read lock coexists with readers but excludes writers and other
+ * upgradeable holders, Upgrade waits for the readers to leave and turns it into the
+ * write lock without any write in between. Every lock has a TryXXXLockFor variant,
+ * used by the guards constructed with a timeout. Not reentrant.
+ */
+class ParkingRWLock {
+    friend class ReadLockGuard<ParkingRWLock>;
+    friend class WriteLockGuard<ParkingRWLock>;
+    friend class UpgradeLockGuard<ParkingRWLock>;
+    friend class ReaderBiasedRWLock<ParkingRWLock>;
+
+public:
+    static const uint32_t SPIN_NUM = 128;
+    static const uint32_t YIELD_NUM = 4;
+    ParkingRWLock() {}
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // state_ bits, wait bits only change under wait_mutex_
+    static const uint32_t READER_MASK = (1U << 27) - 1;
+    static const uint32_t UPGRADER = 1U << 27;
+    static const uint32_t WRITER = 1U << 28;
+    // a writer waits or an upgrader upgrades, new readers queue
+    static const uint32_t WRITER_WAIT = 1U << 29;
+    static const uint32_t READER_WAIT = 1U << 30;
+    static const uint32_t UPGRADER_WAIT = 1U << 31;
+
+    // all these function only can used by ReadLockGuard/WriteLockGuard/UpgradeLockGuard;
+    void ReadLock() { ReadLockUntil(Clock::time_point::max()); }
+    void WriteLock() { WriteLockUntil(Clock::time_point::max()); }
+    void UpgradeLock() { UpgradeLockUntil(Clock::time_point::max()); }
+
+    template <typename Rep, typename Period>
+    bool TryReadLockFor(const std::chrono::duration<Rep, Period>& timeout) {
+        return ReadLockUntil(Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout));
+    }
+    template <typename Rep, typename Period>
+    bool TryWriteLockFor(const std::chrono::duration<Rep, Period>& timeout) {
+        return WriteLockUntil(Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout));
+    }
+    template <typename Rep, typename Period>
+    bool TryUpgradeLockFor(const std::chrono::duration<Rep, Period>& timeout) {
+        return UpgradeLockUntil(Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout));
+    }
+
+    void ReadUnlock() {
+        uint32_t prev = state_.fetch_sub(1, std::memory_order_release);
+        if ((prev & READER_MASK) == 1 && (prev & WRITER_WAIT)) {
+            // the last reader of the phase lets the writer (or upgrading holder) in
+            WakeWriters();
+        }
+    }
+
+    void WriteUnlock() {
+        uint32_t state = WRITER;
+        if (state_.compare_exchange_strong(state, 0, std::memory_order_release, std::memory_order_relaxed)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        // nobody else changes state_ while the write lock is held and wait_mutex_ is taken
+        state = state_.load(std::memory_order_relaxed);
+        uint32_t next = state & (WRITER_WAIT | UPGRADER_WAIT);
+        if (waiting_readers_ > 0) {
+            // readers which queued behind this writer go before the next writer
+            next |= waiting_readers_;
+            waiting_readers_ = 0;
+            state_.store(next, std::memory_order_release);
+            read_seq_.fetch_add(1, std::memory_order_release);
+            FutexWake(&read_seq_, INT_MAX);
+        } else {
+            state_.store(next, std::memory_order_release);
+        }
+        if (next & (WRITER_WAIT | UPGRADER_WAIT)) {
+            WakeWriters();
+        }
+    }
+
+    void UpgradeUnlock() {
+        uint32_t prev = state_.fetch_and(~UPGRADER, std::memory_order_release);
+        if (prev & (WRITER_WAIT | UPGRADER_WAIT)) {
+            WakeWriters();
+        }
+    }
+
+    // upgradeable holder only, other writers and upgraders are excluded already
+    void Upgrade() {
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+            upgrading_ = true;
+            state_.fetch_or(WRITER_WAIT);
+        }
+        uint32_t retry_times = 0;
+        while (true) {
+            uint32_t seq = write_seq_.load(std::memory_order_acquire);
+            uint32_t state = state_.load(std::memory_order_relaxed);
+            if ((state & READER_MASK) == 0 &&
+                state_.compare_exchange_weak(state, (state & ~UPGRADER) | WRITER, std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+                break;
+            }
+            Backoff(&retry_times, &write_seq_, seq, Clock::time_point::max());
+        }
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        upgrading_ = false;
+        if (waiting_writers_ == 0) {
+            // the write lock is held, queued readers are admitted by WriteUnlock
+            state_.fetch_and(~WRITER_WAIT);
+        }
+    }
+
+    bool TryReadFast() {
+        uint32_t state = state_.load(std::memory_order_relaxed);
+        while (!(state & (WRITER | WRITER_WAIT))) {
+            if (state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool TryWriteFast() {
+        uint32_t state = state_.load(std::memory_order_relaxed);
+        while ((state & (WRITER | UPGRADER | READER_MASK)) == 0) {
+            if (state_.compare_exchange_weak(state, state | WRITER, std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // waiting writers go first, upgradeable holders do not take turns with them
+    bool TryUpgradeFast() {
+        uint32_t state = state_.load(std::memory_order_relaxed);
+        while (!(state & (WRITER | UPGRADER | WRITER_WAIT))) {
+            if (state_.compare_exchange_weak(state, state | UPGRADER, std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ReadLockUntil(Clock::time_point deadline) {
+        if (TryReadFast() || SpinFor(&ParkingRWLock::TryReadFast)) {
+            return true;
+        }
+        while (true) {
+            uint32_t seq = 0;
+            // any seq value is a valid wait point, the writer leaving needs its own flag
+            bool must_wait = false;
+            {
+                std::lock_guard<std::mutex> lock(wait_mutex_);
+                // seen by WriteUnlock, which then hands the lock over instead of just dropping it
+                uint32_t prev = state_.fetch_or(READER_WAIT);
+                must_wait = (prev & (WRITER | WRITER_WAIT)) != 0;
+                if (must_wait) {
+                    ++waiting_readers_;
+                    seq = read_seq_.load(std::memory_order_relaxed);
+                } else if (waiting_readers_ == 0) {
+                    state_.fetch_and(~READER_WAIT);
+                }
+            }
+            if (!must_wait) {
+                // the writer left meanwhile
+                if (TryReadFast()) {
+                    return true;
+                }
+                continue;
+            }
+            // the lock is granted when read_seq_ moves
+            while (read_seq_.load(std::memory_order_acquire) == seq) {
+                if (!Park(&read_seq_, seq, deadline)) {
+                    std::lock_guard<std::mutex> lock(wait_mutex_);
+                    if (read_seq_.load(std::memory_order_acquire) != seq) {
+                        return true;
+                    }
+                    if (--waiting_readers_ == 0) {
+                        state_.fetch_and(~READER_WAIT);
+                    }
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    bool WriteLockUntil(Clock::time_point deadline) {
+        if (TryWriteFast() || SpinFor(&ParkingRWLock::TryWriteFast)) {
+            return true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+            ++waiting_writers_;
+            state_.fetch_or(WRITER_WAIT);
+        }
+        bool locked = false;
+        uint32_t retry_times = 0;
+        while (true) {
+            uint32_t seq = write_seq_.load(std::memory_order_acquire);
+            if (TryWriteFast()) {
+                locked = true;
+                break;
+            }
+            if (!Backoff(&retry_times, &write_seq_, seq, deadline)) {
+                break;
+            }
+        }
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        if (--waiting_writers_ == 0 && !upgrading_) {
+            ClearWriterWait();
+        }
+        return locked;
+    }
+
+    bool UpgradeLockUntil(Clock::time_point deadline) {
+        if (TryUpgradeFast() || SpinFor(&ParkingRWLock::TryUpgradeFast)) {
+            return true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+            if (waiting_upgraders_++ == 0) {
+                state_.fetch_or(UPGRADER_WAIT);
+            }
+        }
+        bool locked = false;
+        uint32_t retry_times = 0;
+        while (true) {
+            uint32_t seq = write_seq_.load(std::memory_order_acquire);
+            if (TryUpgradeFast()) {
+                locked = true;
+                break;
+            }
+            if (!Backoff(&retry_times, &write_seq_, seq, deadline)) {
+                break;
+            }
+        }
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        if (--waiting_upgraders_ == 0) {
+            state_.fetch_and(~UPGRADER_WAIT);
+        }
+        return locked;
+    }
+
+    // caller holds wait_mutex_, no writer waits any more
+    void ClearWriterWait() {
+        uint32_t state = state_.fetch_and(~WRITER_WAIT) & ~WRITER_WAIT;
+        // readers queued behind writers which gave up, admit them unless a writer holds the lock
+        while (waiting_readers_ > 0 && !(state & WRITER)) {
+            if (state_.compare_exchange_weak(state, (state + waiting_readers_) & ~READER_WAIT)) {
+                waiting_readers_ = 0;
+                read_seq_.fetch_add(1, std::memory_order_release);
+                FutexWake(&read_seq_, INT_MAX);
+            }
+        }
+        if (state & UPGRADER_WAIT) {
+            WakeWriters();
+        }
+    }
+
+    template <typename TryLock>
+    bool SpinFor(TryLock try_lock) {
+        for (uint32_t i = 0; i < SPIN_NUM; ++i) {
+            hippo_cpu_relax();
+            if ((this->*try_lock)()) {
+                return true;
+            }
+        }
+        for (uint32_t i = 0; i < YIELD_NUM; ++i) {
+            std::this_thread::yield();
+            if ((this->*try_lock)()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // spin and yield a little before parking, return false once deadline has passed
+    bool Backoff(uint32_t* retry_times, std::atomic<uint32_t>* word, uint32_t seq, Clock::time_point deadline) {
+        if (*retry_times < SPIN_NUM) {
+            ++*retry_times;
+            hippo_cpu_relax();
+            return deadline == Clock::time_point::max() || Clock::now() < deadline;
+        }
+        return Park(word, seq, deadline);
+    }
+
+    // sleep while word == seq, return false once deadline has passed
+    bool Park(std::atomic<uint32_t>* word, uint32_t seq, Clock::time_point deadline) {
+        if (deadline == Clock::time_point::max()) {
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, seq, nullptr, nullptr, 0);
+            return true;
+        }
+        auto remain = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - Clock::now()).count();
+        if (remain <= 0) {
+            return false;
+        }
+        struct timespec timeout;
+        timeout.tv_sec = remain / 1000000000;
+        timeout.tv_nsec = remain % 1000000000;
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, seq, &timeout, nullptr, 0);
+        return Clock::now() < deadline;
+    }
+
+    void WakeWriters() {
+        write_seq_.fetch_add(1, std::memory_order_release);
+        FutexWake(&write_seq_, INT_MAX);
+    }
+
+    static void FutexWake(std::atomic<uint32_t>* word, int num) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, num, nullptr, nullptr, 0);
+    }
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+
+    ParkingRWLock(const ParkingRWLock&) = delete;
+    ParkingRWLock& operator=(const ParkingRWLock&) = delete;
+    alignas(CACHELINE_SIZE) std::atomic<uint32_t> state_ = {0};
+    // futex words, bumped to wake the waiters
+    alignas(CACHELINE_SIZE) std::atomic<uint32_t> read_seq_ = {0};
+    std::atomic<uint32_t> write_seq_ = {0};
+    std::mutex wait_mutex_;
+    // guarded by wait_mutex_
+    uint32_t waiting_readers_ = 0;
+    uint32_t waiting_writers_ = 0;
+    uint32_t waiting_upgraders_ = 0;
+    bool upgrading_ = false;
+};
+
+/**
+ * @brief Reader biased wrapper of a RW lock (Dice and Kogan, BRAVO)
+ *
+ * While the lock is read biased, a reader only claims the slot of its thread, one
+ * cache line per slot, so readers on different threads write no shared cache line.
+ * A writer takes the underlying lock, revokes the bias and waits until every slot is
+ * released. Readers then use the underlying lock, until the bias is enabled again by a
+ * reader once INHIBIT_MULTIPLIER times the revocation time has passed, which bounds
+ * the cost of revocations when writes are frequent. A reader whose slot is taken by
+ * another thread (thread index collision) or by itself (nested read lock) also falls
+ * back to the underlying lock, so nested read locks are no safer than with the
+ * underlying lock itself.
+ *
+ * @tparam RWLock Underlying lock, used by writers and slow path readers
+ */
+template <typename RWLock = AtomicRWLock>
+class ReaderBiasedRWLock {
+    friend class ReadLockGuard<ReaderBiasedRWLock<RWLock>>;
+    friend class WriteLockGuard<ReaderBiasedRWLock<RWLock>>;
+
+public:
+    static const uint32_t SLOT_NUM = 64;
+    static const int64_t INHIBIT_MULTIPLIER = 9;
+
+    ReaderBiasedRWLock() {}
+    // write_first only applies to the underlying lock
+    explicit ReaderBiasedRWLock(bool write_first) : lock_(write_first) {}
+
+private:
+    struct alignas(CACHELINE_SIZE) ReaderSlot {
+        // id of the reading thread, 0 if free
+        std::atomic<uint64_t> owner = {0};
+    };
+
+    // all these function only can used by ReadLockGuard/WriteLockGuard;
+    void ReadLock() {
+        if (read_bias_.load(std::memory_order_relaxed)) {
+            const uint64_t id = ThreadId();
+            ReaderSlot& slot = slots_[id % SLOT_NUM];
+            uint64_t free_owner = 0;
+            // seq_cst claim then bias check, pairs with the bias store then slot scan in WriteLock
+            if (slot.owner.load(std::memory_order_relaxed) == 0 && slot.owner.compare_exchange_strong(free_owner, id)) {
+                if (hippo_likely(read_bias_.load())) {
+                    return;
+                }
+                // a writer is revoking the bias
+                slot.owner.store(0, std::memory_order_release);
+            }
+        }
+        lock_.ReadLock();
+        if (!read_bias_.load(std::memory_order_relaxed) && Now() >= inhibit_until_.load(std::memory_order_relaxed)) {
+            // no writer holds the lock now, the next one revokes the bias again
+            read_bias_.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    void ReadUnlock() {
+        const uint64_t id = ThreadId();
+        ReaderSlot& slot = slots_[id % SLOT_NUM];
+        if (slot.owner.load(std::memory_order_relaxed) == id) {
+            slot.owner.store(0, std::memory_order_release);
+            return;
+        }
+        lock_.ReadUnlock();
+    }
+
+    void WriteLock() {
+        lock_.WriteLock();
+        if (read_bias_.load(std::memory_order_relaxed)) {
+            const int64_t start = Now();
+            read_bias_.store(false);
+            for (auto& slot : slots_) {
+                uint32_t retry_times = 0;
+                // acquire, the finished reads happen before the write
+                while (slot.owner.load() != 0) {
+                    if (++retry_times == AtomicRWLock::MAX_RETRY_TIMES) {
+                        // saving cpu
+                        std::this_thread::yield();
+                        retry_times = 0;
+                    }
+                }
+            }
+            const int64_t now = Now();
+            inhibit_until_.store(now + (now - start) * INHIBIT_MULTIPLIER, std::memory_order_relaxed);
+        }
+    }
+
+    void WriteUnlock() { lock_.WriteUnlock(); }
+
+    // unique per thread, never reused, threads started one after another get different slots
+    static uint64_t ThreadId() {
+        static std::atomic<uint64_t> next_id = {1};
+        static thread_local uint64_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    static int64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    ReaderBiasedRWLock(const ReaderBiasedRWLock&) = delete;
+    ReaderBiasedRWLock& operator=(const ReaderBiasedRWLock&) = delete;
+    ReaderSlot slots_[SLOT_NUM];
+    alignas(CACHELINE_SIZE) std::atomic<bool> read_bias_ = {true};
+    std::atomic<int64_t> inhibit_until_ = {0};
+    RWLock lock_;
+};
+
 NAMESPACE_COMMON_END
 NAMESPACE_HIPPO_END
 
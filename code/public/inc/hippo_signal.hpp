@@ -8,12 +8,27 @@
 #define __HIPPO_SIGNAL_HPP__
 
 #include <algorithm>
-#include <functional>
-#include <list>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "hippo_namespace.hpp"
+#include "hippo_bounded_queue.hpp"
+#include "hippo_function.hpp"
+#include "hippo_lock_guard.hpp"
+#include "hippo_macro.hpp"
+#include "hippo_rcu.hpp"
+
+#ifndef HIPPO_SLOT_INLINE_SIZE
+#define HIPPO_SLOT_INLINE_SIZE HIPPO_FUNCTION_INLINE_SIZE
+#endif
 
 NAMESPACE_HIPPO_BEGIN
 NAMESPACE_COMMON_BEGIN
@@ -24,84 +39,148 @@ class Slot;
 template <typename... Args>
 class Connection;
 
+template <typename Executor, typename... Args>
+class AsyncSlot;
+
+// whether Executor has a TryPost(f) which returns false instead of running f on the caller
+template <typename Executor, typename = void>
+struct HasTryPost : std::false_type {};
+
+template <typename Executor>
+struct HasTryPost<Executor, decltype(void(std::declval<Executor&>().TryPost(std::declval<void (*)()>())))>
+    : std::true_type {};
+
+enum class DeliveryPolicy {
+    // the slot runs on the emitting thread
+    DIRECT,
+    // every event is queued, the slot runs on the executor
+    QUEUED,
+    // only the latest undelivered event is kept, the slot runs on the executor
+    COALESCED,
+};
+
+struct DeliveryOptions {
+    DeliveryPolicy policy = DeliveryPolicy::QUEUED;
+    // pending events of a queued slot, events emitted while it is full are dropped
+    uint64_t queue_size = 1024;
+    // events delivered by one executor task before it yields the executor to other work
+    uint32_t batch_size = 64;
+};
+
+/**
+ * @brief Signal calling every connected slot on emission
+ *
+ * The slots are kept in an immutable vector published through an RcuSnapshot. Emission
+ * pins the epoch and walks the current vector, it takes no lock, allocates nothing and
+ * touches no reference count. Connect and Disconnect copy the vector under the write
+ * lock and publish the copy, the old vector is freed by the epoch reclaimer.
+ * Disconnect only switches the slot off, the vector is compacted once disconnected slots
+ * make up half of it or by the next Connect, which copies the vector anyway.
+ *
+ * A slot connected with an executor (anything with Post(f), e.g. ThreadPool or
+ * NumaThreadPool) does not run on the emitting thread. Emission stores the event in the
+ * slot and the slot schedules one executor task for all the events pending at that
+ * time, so a slow slot costs the emitter one enqueue. The events of one slot are
+ * delivered in order by one task at a time. The executor must outlive the connection.
+ * See AsyncSlot for what happens when the executor is saturated.
+ *
+ * Arguments are passed to every slot by const reference, they are copied only into
+ * the events of queued slots.
+ */
 template <typename... Args>
 class Signal {
 public:
-    using Callback = std::function<void(Args...)>;
+    using Callback = typename Slot<Args...>::Callback;
     using SlotPtr = std::shared_ptr<Slot<Args...>>;
-    using SlotList = std::list<SlotPtr>;
+    using SlotVector = std::vector<SlotPtr>;
     using ConnectionType = Connection<Args...>;
 
     Signal() {}
-    virtual ~Signal() { DisconnectAllSlots(); }
-
-    void operator()(Args... args) {
-        SlotList local;
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            for (auto& slot : slots_) {
-                local.emplace_back(slot);
-            }
+    virtual ~Signal() {
+        // no publish, the current vector is deleted with slots_ and must not be retired from here
+        for (auto& slot : *slots_.Get()) {
+            slot->Disconnect();
         }
+    }
 
-        if (!local.empty()) {
-            for (auto& slot : local) {
-                (*slot)(args...);
-            }
+    void operator()(const Args&... args) {
+        ReadLockGuard<RcuSnapshot<SlotVector>> guard(slots_);
+        for (auto& slot : *slots_.Get()) {
+            (*slot)(args...);
         }
+    }
 
-        ClearDisconnectedSlots();
+    ConnectionType Connect(Callback cb) {
+        auto slot = std::make_shared<Slot<Args...>>(std::move(cb));
+        slots_.Update([this, &slot](SlotVector* slots) {
+            Compact(slots);
+            slots->emplace_back(slot);
+        });
+
+        return ConnectionType(slot, this);
     }
 
-    ConnectionType Connect(const Callback& cb) {
-        auto slot = std::make_shared<Slot<Args...>>(cb);
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            slots_.emplace_back(slot);
+    template <typename Executor>
+    ConnectionType Connect(Callback cb, Executor& executor, const DeliveryOptions& options = DeliveryOptions()) {
+        if (options.policy == DeliveryPolicy::DIRECT) {
+            return Connect(std::move(cb));
         }
+        SlotPtr slot = std::make_shared<AsyncSlot<Executor, Args...>>(std::move(cb), executor, options);
+        slots_.Update([this, &slot](SlotVector* slots) {
+            Compact(slots);
+            slots->emplace_back(slot);
+        });
 
         return ConnectionType(slot, this);
     }
 
     bool Disconnect(const ConnectionType& conn) {
+        WriteLockGuard<RcuSnapshot<SlotVector>> guard(slots_);
+        // the current vector only changes under the write lock
+        const SlotVector* slots = slots_.Get();
         bool find = false;
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            for (auto& slot : slots_) {
-                if (conn.HasSlot(slot)) {
-                    find = true;
-                    slot->Disconnect();
-                }
+        for (auto& slot : *slots) {
+            // a disconnected slot may wait in the vector for the next compaction
+            if (conn.HasSlot(slot) && slot->connected()) {
+                find = true;
+                slot->Disconnect();
+                ++disconnected_num_;
             }
         }
 
-        if (find) {
-            ClearDisconnectedSlots();
+        if (find && disconnected_num_ * 2 >= slots->size()) {
+            SlotVector* copy = slots_.Copy();
+            Compact(copy);
+            slots_.Publish(copy);
         }
         return find;
     }
 
     void DisconnectAllSlots() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        for (auto& slot : slots_) {
-            slot->Disconnect();
-        }
-        slots_.clear();
+        slots_.Update([this](SlotVector* slots) {
+            for (auto& slot : *slots) {
+                slot->Disconnect();
+            }
+            slots->clear();
+            disconnected_num_ = 0;
+        });
     }
 
 private:
     Signal(const Signal&) = delete;
     Signal& operator=(const Signal&) = delete;
 
-    void ClearDisconnectedSlots() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        slots_.erase(
-            std::remove_if(slots_.begin(), slots_.end(), [](const SlotPtr& slot) { return !slot->connected(); }),
-            slots_.end());
+    // caller holds the write lock
+    void Compact(SlotVector* slots) {
+        slots->erase(
+            std::remove_if(slots->begin(), slots->end(), [](const SlotPtr& slot) { return !slot->connected(); }),
+            slots->end());
+        disconnected_num_ = 0;
     }
 
-    SlotList slots_;
-    std::mutex mutex_;
+    RcuSnapshot<SlotVector> slots_;
+    // disconnected slots still in the current vector, guarded by the write lock
+    std::size_t disconnected_num_ = 0;
 };
 
 template <typename... Args>
@@ -146,6 +225,15 @@ public:
         return false;
     }
 
+    // events waiting for delivery, always 0 for a direct connection
+    uint64_t QueueDepth() const { return slot_ ? slot_->QueueDepth() : 0; }
+
+    // events dropped by a full queue or overwritten by a newer one before delivery
+    uint64_t DropNum() const { return slot_ ? slot_->DropNum() : 0; }
+
+    // batches delivered on the scheduling thread because the executor was saturated
+    uint64_t InlineNum() const { return slot_ ? slot_->InlineNum() : 0; }
+
 private:
     SlotPtr slot_;
     SignalPtr signal_;
@@ -154,23 +242,187 @@ private:
 template <typename... Args>
 class Slot {
 public:
-    using Callback = std::function<void(Args...)>;
-    Slot(const Slot& another) : cb_(another.cb_), connected_(another.connected_) {}
-    explicit Slot(const Callback& cb, bool connected = true) : cb_(cb), connected_(connected) {}
+    // inline storage, a capture larger than HIPPO_SLOT_INLINE_SIZE bytes is allocated
+    using Callback = InplaceFunction<void(const Args&...), HIPPO_SLOT_INLINE_SIZE>;
+    Slot(const Slot& another) = delete;
+    explicit Slot(Callback cb, bool connected = true) : cb_(std::move(cb)), connected_(connected) {}
     virtual ~Slot() {}
 
-    void operator()(Args... args) {
-        if (connected_ && cb_) {
+    virtual void operator()(const Args&... args) {
+        if (connected() && cb_) {
             cb_(args...);
         }
     }
 
-    void Disconnect() { connected_ = false; }
-    bool connected() const { return connected_; }
+    virtual uint64_t QueueDepth() const { return 0; }
+    virtual uint64_t DropNum() const { return 0; }
+    virtual uint64_t InlineNum() const { return 0; }
+
+    // emitters may still be running the callback when this returns
+    void Disconnect() { connected_.store(false, std::memory_order_release); }
+    bool connected() const { return connected_.load(std::memory_order_acquire); }
+
+protected:
+    // run the callback regardless of the connection state
+    void Deliver(const Args&... args) {
+        if (cb_) {
+            cb_(args...);
+        }
+    }
 
 private:
     Callback cb_;
-    bool connected_ = true;
+    std::atomic<bool> connected_ = {true};
+};
+
+/**
+ * @brief Slot delivering its events through an executor
+ *
+ * At most one drain task of the slot is posted at a time, scheduled_ is owned by whoever
+ * set it: the emitter which finds it clear posts the task, and the task clears it when
+ * nothing is left, then takes it back if an event arrived meanwhile.
+ *
+ * With an executor offering TryPost (ThreadPool, WorkStealingThreadPool, NumaThreadPool)
+ * a saturated executor is retried a few times. When it stays saturated, the thread which
+ * schedules, the emitter or a worker finishing a batch, delivers the batch itself rather
+ * than leave events stranded, and InlineNum counts it. An executor with only Post
+ * applies its own saturation policy, ThreadPool::Post would run the task on the emitter
+ * without it being counted.
+ */
+template <typename Executor, typename... Args>
+class AsyncSlot : public Slot<Args...>, public std::enable_shared_from_this<AsyncSlot<Executor, Args...>> {
+public:
+    using Callback = typename Slot<Args...>::Callback;
+    using Event = std::tuple<typename std::decay<Args>::type...>;
+
+    AsyncSlot(Callback cb, Executor& executor, const DeliveryOptions& options)
+        : Slot<Args...>(std::move(cb)),
+          executor_(executor),
+          coalesced_(options.policy == DeliveryPolicy::COALESCED),
+          batch_size_(std::max<uint32_t>(options.batch_size, 1)) {
+        if (!coalesced_ && !queue_.Init(options.queue_size, new BusySpinWaitStrategy())) {
+            throw std::bad_alloc();
+        }
+    }
+
+    void operator()(const Args&... args) override {
+        if (!this->connected()) {
+            return;
+        }
+        if (coalesced_) {
+            std::lock_guard<std::mutex> lock(latest_mutex_);
+            if (has_latest_) {
+                drop_num_.fetch_add(1, std::memory_order_relaxed);
+            }
+            latest_ = Event(args...);
+            has_latest_ = true;
+        } else if (!queue_.Enqueue(Event(args...))) {
+            drop_num_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // seq_cst, pairs with the exchange in Drain, either this emitter or the task sees the event
+        if (!scheduled_.exchange(true)) {
+            Schedule();
+        }
+    }
+
+    uint64_t QueueDepth() const override {
+        if (coalesced_) {
+            std::lock_guard<std::mutex> lock(latest_mutex_);
+            return has_latest_ ? 1 : 0;
+        }
+        return queue_.Size();
+    }
+
+    uint64_t DropNum() const override { return drop_num_.load(std::memory_order_relaxed); }
+
+    uint64_t InlineNum() const override { return inline_num_.load(std::memory_order_relaxed); }
+
+private:
+    static const uint32_t POST_RETRY_NUM = 16;
+
+    // caller owns scheduled_
+    void Schedule() {
+        while (!PostDrain()) {
+            inline_num_.fetch_add(1, std::memory_order_relaxed);
+            if (!Drain()) {
+                return;
+            }
+        }
+    }
+
+    // false when the executor stays saturated
+    bool PostDrain() {
+        auto self = this->shared_from_this();
+        auto task = [self] {
+            if (self->Drain()) {
+                self->Schedule();
+            }
+        };
+        if constexpr (HasTryPost<Executor>::value) {
+            for (uint32_t i = 0; i < POST_RETRY_NUM; ++i) {
+                if (executor_.TryPost(task)) {
+                    return true;
+                }
+                std::this_thread::yield();
+            }
+            return false;
+        } else {
+            executor_.Post(std::move(task));
+            return true;
+        }
+    }
+
+    // deliver one batch, return true when the batch is full and scheduled_ is kept for the next one
+    bool Drain() {
+        while (true) {
+            uint32_t num = 0;
+            Event event;
+            while (num < batch_size_ && Pop(&event)) {
+                // events of a disconnected slot are dropped
+                if (this->connected()) {
+                    std::apply([this](auto&... args) { this->Deliver(args...); }, event);
+                }
+                ++num;
+            }
+            if (num == batch_size_) {
+                // keep scheduled_, let the executor run other tasks before the next batch
+                return true;
+            }
+            scheduled_.exchange(false);
+            if (Empty() || scheduled_.exchange(true)) {
+                return false;
+            }
+            // an emitter pushed after the last Pop but saw the task still scheduled
+            hippo_cpu_relax();
+        }
+    }
+
+    bool Pop(Event* event) {
+        if (coalesced_) {
+            std::lock_guard<std::mutex> lock(latest_mutex_);
+            if (!has_latest_) {
+                return false;
+            }
+            *event = std::move(latest_);
+            has_latest_ = false;
+            return true;
+        }
+        return queue_.Dequeue(event);
+    }
+
+    bool Empty() const { return QueueDepth() == 0; }
+
+    Executor& executor_;
+    const bool coalesced_;
+    const uint32_t batch_size_;
+    mutable BoundedQueue<Event> queue_;
+    mutable std::mutex latest_mutex_;
+    Event latest_;
+    bool has_latest_ = false;
+    std::atomic<bool> scheduled_ = {false};
+    std::atomic<uint64_t> drop_num_ = {0};
+    std::atomic<uint64_t> inline_num_ = {0};
 };
 
 NAMESPACE_COMMON_END
@@ -0,0 +1,374 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_TASK_HPP__
+#define __HIPPO_TASK_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "hippo_namespace.hpp"
+#include "hippo_bounded_queue.hpp"
+#include "hippo_function.hpp"
+#include "hippo_macro.hpp"
+
+#ifndef HIPPO_TASK_INLINE_SIZE
+#define HIPPO_TASK_INLINE_SIZE HIPPO_FUNCTION_INLINE_SIZE
+#endif
+
+NAMESPACE_HIPPO_BEGIN
+NAMESPACE_COMMON_BEGIN
+
+// move-only void() callable, see InplaceFunction
+template <std::size_t InlineSize = HIPPO_TASK_INLINE_SIZE>
+using InlineTask = InplaceFunction<void(), InlineSize>;
+
+using Task = InlineTask<>;
+
+// Bind f with args into a move-only nullary callable, args are stored by value like std::bind
+template <typename F, typename... Args>
+auto BindTask(F &&f, Args &&... args) {
+    return [f = std::forward<F>(f), args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+        return std::apply(f, args);
+    };
+}
+
+// Result holder of TaskState, unify void and non-void results
+template <typename R>
+struct TaskResult {
+    template <typename... V>
+    explicit TaskResult(V &&... v) : value(std::forward<V>(v)...) {}
+    R Take() && { return std::move(value); }
+    R value;
+};
+
+template <>
+struct TaskResult<void> {
+    TaskResult() {}
+    void Take() && {}
+};
+
+/**
+ * @brief Shared state of TaskPromise/TaskFuture
+ *
+ * States are recycled through magazines (Bonwick, Magazines and Vmem) of MAGAZINE_SIZE
+ * states, like ObjectPool. Every thread owns a loaded and a previous magazine, and
+ * exchanges whole magazines with a shared depot of full and empty ones when both run
+ * empty (or full). A state goes back to the thread which drops the last reference, so
+ * with producer threads creating states and consumer threads releasing them, the
+ * depot carries the states back to the producers, and in steady state a
+ * promise/future pair does not touch the global allocator.
+ */
+template <typename R>
+class TaskState {
+public:
+    using Value = TaskResult<R>;
+    static const std::size_t MAGAZINE_SIZE = 32;
+    // full magazines the depot keeps, states beyond are freed
+    static const std::size_t DEPOT_MAGAZINES = 64;
+
+    static TaskState *Create() {
+        Cache &cache = LocalCache();
+        if (hippo_unlikely(cache.loaded->count == 0)) {
+            if (cache.previous->count == 0) {
+                Magazine *full = nullptr;
+                if (!GetDepot().full.Dequeue(&full)) {
+                    return new TaskState();
+                }
+                PutEmpty(cache.previous);
+                cache.previous = full;
+            }
+            std::swap(cache.loaded, cache.previous);
+        }
+        return cache.loaded->states[--cache.loaded->count];
+    }
+
+    void Release() {
+        if (ref_count_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        Clear();
+        Cache &cache = LocalCache();
+        if (hippo_unlikely(cache.loaded->count == MAGAZINE_SIZE)) {
+            if (cache.previous->count == MAGAZINE_SIZE) {
+                PutFull(cache.previous);
+                cache.previous = GetEmpty();
+            }
+            std::swap(cache.loaded, cache.previous);
+        }
+        cache.loaded->states[cache.loaded->count++] = this;
+    }
+
+    template <typename... V>
+    void SetValue(V &&... value) {
+        new (&storage_) Value(std::forward<V>(value)...);
+        has_value_ = true;
+        MarkReady();
+    }
+
+    void SetException(std::exception_ptr exception) {
+        exception_ = exception;
+        MarkReady();
+    }
+
+    bool Ready() const { return ready_.load(std::memory_order_acquire); }
+
+    void Wait() {
+        if (Ready()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiting_.store(true);
+        cv_.wait(lock, [this] { return Ready(); });
+    }
+
+    R Get() {
+        Wait();
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+        return std::move(*reinterpret_cast<Value *>(&storage_)).Take();
+    }
+
+private:
+    struct Magazine {
+        std::size_t count = 0;
+        TaskState *states[MAGAZINE_SIZE];
+    };
+
+    struct Depot {
+        Depot() {
+            // bounded queues never block here, a failed call is handled as full or empty
+            full.Init(DEPOT_MAGAZINES, new BusySpinWaitStrategy());
+            empty.Init(DEPOT_MAGAZINES, new BusySpinWaitStrategy());
+        }
+        BoundedQueue<Magazine *> full;
+        BoundedQueue<Magazine *> empty;
+    };
+
+    // either magazine is always full or empty, only the loaded one may be partial
+    struct Cache {
+        Cache() : loaded(GetEmpty()), previous(GetEmpty()) {}
+        ~Cache() {
+            for (Magazine *magazine : {loaded, previous}) {
+                if (magazine->count == MAGAZINE_SIZE) {
+                    PutFull(magazine);
+                } else {
+                    FreeStates(magazine);
+                    PutEmpty(magazine);
+                }
+            }
+        }
+        Magazine *loaded;
+        Magazine *previous;
+    };
+
+    static Cache &LocalCache() {
+        static thread_local Cache cache;
+        return cache;
+    }
+
+    // threads may exit after static destruction, never destroyed
+    static Depot &GetDepot() {
+        static Depot *depot = new Depot();
+        return *depot;
+    }
+
+    static Magazine *GetEmpty() {
+        Magazine *magazine = nullptr;
+        return GetDepot().empty.Dequeue(&magazine) ? magazine : new Magazine();
+    }
+
+    static void PutEmpty(Magazine *magazine) {
+        if (!GetDepot().empty.Enqueue(magazine)) {
+            delete magazine;
+        }
+    }
+
+    static void PutFull(Magazine *magazine) {
+        if (!GetDepot().full.Enqueue(magazine)) {
+            FreeStates(magazine);
+            PutEmpty(magazine);
+        }
+    }
+
+    static void FreeStates(Magazine *magazine) {
+        while (magazine->count > 0) {
+            delete magazine->states[--magazine->count];
+        }
+    }
+
+    TaskState() = default;
+
+    void MarkReady() {
+        // ready_ must be published before waiting_ is checked, pairs with Wait()
+        ready_.store(true);
+        if (waiting_.load()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_all();
+        }
+    }
+
+    void Clear() {
+        if (has_value_) {
+            reinterpret_cast<Value *>(&storage_)->~Value();
+            has_value_ = false;
+        }
+        exception_ = nullptr;
+        ready_.store(false, std::memory_order_relaxed);
+        waiting_.store(false, std::memory_order_relaxed);
+        ref_count_.store(2, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint32_t> ref_count_ = {2};
+    std::atomic<bool> ready_ = {false};
+    std::atomic<bool> waiting_ = {false};
+    bool has_value_ = false;
+    std::exception_ptr exception_ = nullptr;
+    typename std::aligned_storage<sizeof(Value), alignof(Value)>::type storage_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+template <typename R>
+class TaskPromise;
+
+/**
+ * @brief Lightweight replacement of std::future for tasks
+ */
+template <typename R>
+class TaskFuture {
+    friend class TaskPromise<R>;
+
+public:
+    TaskFuture() = default;
+    TaskFuture(TaskFuture &&other) noexcept : state_(other.state_) { other.state_ = nullptr; }
+    TaskFuture &operator=(TaskFuture &&other) noexcept {
+        if (this != &other) {
+            Reset();
+            state_ = other.state_;
+            other.state_ = nullptr;
+        }
+        return *this;
+    }
+    TaskFuture(const TaskFuture &other) = delete;
+    TaskFuture &operator=(const TaskFuture &other) = delete;
+    ~TaskFuture() { Reset(); }
+
+    // same semantics as std::future, the future is invalid after get()
+    R get() {
+        if (state_ == nullptr) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        TaskState<R> *state = state_;
+        state_ = nullptr;
+        struct Releaser {
+            ~Releaser() { state->Release(); }
+            TaskState<R> *state;
+        } releaser{state};
+        return state->Get();
+    }
+
+    void wait() const {
+        if (state_ != nullptr) {
+            state_->Wait();
+        }
+    }
+
+    bool ready() const { return state_ != nullptr && state_->Ready(); }
+    bool valid() const { return state_ != nullptr; }
+
+private:
+    explicit TaskFuture(TaskState<R> *state) : state_(state) {}
+
+    void Reset() {
+        if (state_ != nullptr) {
+            state_->Release();
+            state_ = nullptr;
+        }
+    }
+
+    TaskState<R> *state_ = nullptr;
+};
+
+template <typename R>
+class TaskPromise {
+public:
+    TaskPromise() : state_(TaskState<R>::Create()) {}
+    TaskPromise(TaskPromise &&other) noexcept : state_(other.state_), future_retrieved_(other.future_retrieved_) {
+        other.state_ = nullptr;
+    }
+    TaskPromise &operator=(TaskPromise &&other) noexcept {
+        if (this != &other) {
+            Abandon();
+            state_ = other.state_;
+            future_retrieved_ = other.future_retrieved_;
+            other.state_ = nullptr;
+        }
+        return *this;
+    }
+    TaskPromise(const TaskPromise &other) = delete;
+    TaskPromise &operator=(const TaskPromise &other) = delete;
+    ~TaskPromise() { Abandon(); }
+
+    TaskFuture<R> GetFuture() {
+        if (future_retrieved_) {
+            throw std::future_error(std::future_errc::future_already_retrieved);
+        }
+        future_retrieved_ = true;
+        return TaskFuture<R>(state_);
+    }
+
+    // run fn and store its result or exception
+    template <typename Fn>
+    void Run(Fn &&fn) {
+        try {
+            if constexpr (std::is_void<R>::value) {
+                fn();
+                state_->SetValue();
+            } else {
+                state_->SetValue(fn());
+            }
+        } catch (...) {
+            state_->SetException(std::current_exception());
+        }
+        Detach();
+    }
+
+private:
+    void Detach() {
+        if (!future_retrieved_) {
+            // nobody holds the future side
+            state_->Release();
+        }
+        state_->Release();
+        state_ = nullptr;
+    }
+
+    void Abandon() {
+        if (state_ != nullptr) {
+            state_->SetException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            Detach();
+        }
+    }
+
+    TaskState<R> *state_ = nullptr;
+    bool future_retrieved_ = false;
+};
+
+NAMESPACE_COMMON_END
+NAMESPACE_HIPPO_END
+
+#endif  // !__HIPPO_TASK_HPP__
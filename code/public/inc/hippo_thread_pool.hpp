@@ -8,10 +8,10 @@
 #define __HIPPO_THREAD_POOL_HPP__
 
 #include <atomic>
+#include <condition_variable>
 #include <functional>
-#include <future>
 #include <memory>
-#include <queue>
+#include <mutex>
 #include <stdexcept>
 #include <thread>
 #include <utility>
@@ -19,46 +19,126 @@
 
 #include "hippo_namespace.hpp"
 #include "hippo_bounded_queue.hpp"
+#include "hippo_macro.hpp"
+#include "hippo_numa.hpp"
+#include "hippo_task.hpp"
+#include "hippo_work_stealing_deque.hpp"
 
 NAMESPACE_HIPPO_BEGIN
 NAMESPACE_COMMON_BEGIN
 
+// Enqueue a task slot into a queue as large as the slot pool. Enqueue only fails transiently
+// while a consumer still reads the slot, which may be preempted, so back off instead of spinning hot
+inline void EnqueueTaskSlot(BoundedQueue<Task*>* queue, Task* task) {
+    static const uint32_t MAX_SPIN_TIMES = 128;
+    for (uint32_t i = 0; hippo_unlikely(!queue->Enqueue(task)); ++i) {
+        if (i < MAX_SPIN_TIMES) {
+            hippo_cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+ * @brief Fixed set of preallocated task slots
+ *
+ * Tasks are constructed in place inside a free slot, so submitting a task
+ * only moves slot pointers through the queues and never allocates.
+ */
+class TaskSlotPool {
+public:
+    explicit TaskSlotPool(std::size_t size) : slots_(new Task[size]) {
+        if (!free_slots_.Init(size, new BusySpinWaitStrategy())) {
+            throw std::runtime_error("Task slot pool init failed.");
+        }
+        for (std::size_t i = 0; i < size; ++i) {
+            free_slots_.Enqueue(&slots_[i]);
+        }
+    }
+    TaskSlotPool(const TaskSlotPool& other) = delete;
+    TaskSlotPool& operator=(const TaskSlotPool& other) = delete;
+
+    // return nullptr when all slots are in use
+    Task* Acquire() {
+        Task* slot = nullptr;
+        return free_slots_.Dequeue(&slot) ? slot : nullptr;
+    }
+
+    void Release(Task* slot) {
+        slot->Reset();
+        EnqueueTaskSlot(&free_slots_, slot);
+    }
+
+private:
+    std::unique_ptr<Task[]> slots_;
+    BoundedQueue<Task*> free_slots_;
+};
+
+// runs first on each worker thread with the worker index, e.g. to pin it
+using WorkerInitFunc = std::function<void(std::size_t)>;
+
 class ThreadPool {
 public:
-    explicit ThreadPool(std::size_t thread_num, std::size_t max_task_num = 1000) : stop_(false) {
-        if (!task_queue_.Init(max_task_num, new BlockWaitStrategy())) {
+    explicit ThreadPool(std::size_t thread_num, std::size_t max_task_num = 1000,
+                        WorkerInitFunc init_worker = WorkerInitFunc())
+        : task_slots_(max_task_num), stop_(false) {
+        if (!task_queue_.Init(max_task_num, new AdaptiveWaitStrategy())) {
             throw std::runtime_error("Task queue init failed.");
         }
         workers_.reserve(thread_num);
         for (size_t i = 0; i < thread_num; ++i) {
-            workers_.emplace_back([this] {
+            workers_.emplace_back([this, i, init_worker] {
+                if (init_worker) {
+                    init_worker(i);
+                }
                 while (!stop_) {
-                    std::function<void()> task;
+                    Task* task = nullptr;
                     if (task_queue_.WaitDequeue(&task)) {
-                        task();
+                        (*task)();
+                        task_slots_.Release(task);
                     }
                 }
             });
         }
     };
 
+    // When all max_task_num slots are in use the task runs on the calling thread before
+    // Enqueue/Post returns, use TryPost to keep the caller free of tasks
     template <typename F, typename... Args>
-    auto Enqueue(F&& f, Args&&... args) -> std::future<typename std::result_of<F(Args...)>::type> {
+    auto Enqueue(F&& f, Args&&... args) -> TaskFuture<typename std::result_of<F(Args...)>::type> {
         using return_type = typename std::result_of<F(Args...)>::type;
 
-        auto task = std::make_shared<std::packaged_task<return_type()>>(
-            std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-
-        std::future<return_type> res = task->get_future();
-
         // don't allow enqueueing after stopping the pool
         if (stop_) {
-            return std::future<return_type>();
+            return TaskFuture<return_type>();
         }
-        task_queue_.Enqueue([task]() { (*task)(); });
+        TaskPromise<return_type> promise;
+        TaskFuture<return_type> res = promise.GetFuture();
+        auto func = BindTask(std::forward<F>(f), std::forward<Args>(args)...);
+        Submit([promise = std::move(promise), func = std::move(func)]() mutable { promise.Run(func); });
         return res;
     }
 
+    // fire-and-forget, no future is created
+    template <typename F, typename... Args>
+    void Post(F&& f, Args&&... args) {
+        if (stop_) {
+            return;
+        }
+        Submit(BindTask(std::forward<F>(f), std::forward<Args>(args)...));
+    }
+
+    // never runs the task on the calling thread, return false and drop the task when the
+    // pool is stopped or saturated
+    template <typename F, typename... Args>
+    bool TryPost(F&& f, Args&&... args) {
+        if (stop_) {
+            return false;
+        }
+        return TrySubmit(BindTask(std::forward<F>(f), std::forward<Args>(args)...));
+    }
+
     ~ThreadPool() {
         if (stop_.exchange(true)) {
             return;
@@ -67,14 +147,290 @@ public:
         for (std::thread& worker : workers_) {
             worker.join();
         }
+        // all workers have exited, drop the tasks which never ran
+        Task* task = nullptr;
+        while (task_queue_.Dequeue(&task)) {
+            task_slots_.Release(task);
+        }
+    }
+
+private:
+    template <typename F>
+    void Submit(F&& func) {
+        // func is left untouched when no slot is free
+        if (hippo_unlikely(!TrySubmit(std::forward<F>(func)))) {
+            // pool is saturated, run on the caller thread
+            func();
+        }
+    }
+
+    template <typename F>
+    bool TrySubmit(F&& func) {
+        Task* task = task_slots_.Acquire();
+        if (hippo_unlikely(task == nullptr)) {
+            return false;
+        }
+        task->Emplace(std::forward<F>(func));
+        EnqueueTaskSlot(&task_queue_, task);
+        return true;
+    }
+
+    std::vector<std::thread> workers_;
+    TaskSlotPool task_slots_;
+    BoundedQueue<Task*> task_queue_;
+    std::atomic_bool stop_;
+};
+
+/**
+ * @brief Thread pool with one Chase-Lev deque per worker
+ *
+ * Tasks enqueued from a worker thread go to that worker's own deque, tasks
+ * enqueued from other threads go to a shared injection queue. Idle workers
+ * steal from the top of the other workers' deques.
+ */
+class WorkStealingThreadPool {
+public:
+    explicit WorkStealingThreadPool(std::size_t thread_num, std::size_t max_task_num = 1000,
+                                    WorkerInitFunc init_worker = WorkerInitFunc())
+        : task_slots_(max_task_num), stop_(false) {
+        // workers never block on the injection queue, they park on cv_ instead
+        if (!inject_queue_.Init(max_task_num, new BusySpinWaitStrategy())) {
+            throw std::runtime_error("Task queue init failed.");
+        }
+        local_queues_.reserve(thread_num);
+        for (size_t i = 0; i < thread_num; ++i) {
+            local_queues_.emplace_back(new WorkStealingDeque<Task*>());
+        }
+        workers_.reserve(thread_num);
+        for (size_t i = 0; i < thread_num; ++i) {
+            workers_.emplace_back([this, i, init_worker] {
+                if (init_worker) {
+                    init_worker(i);
+                }
+                Run(i);
+            });
+        }
+    }
+
+    // When all max_task_num slots are in use the task runs on the calling thread before
+    // Enqueue/Post returns, use TryPost to keep the caller free of tasks
+    template <typename F, typename... Args>
+    auto Enqueue(F&& f, Args&&... args) -> TaskFuture<typename std::result_of<F(Args...)>::type> {
+        using return_type = typename std::result_of<F(Args...)>::type;
+
+        // don't allow enqueueing after stopping the pool
+        if (stop_) {
+            return TaskFuture<return_type>();
+        }
+        TaskPromise<return_type> promise;
+        TaskFuture<return_type> res = promise.GetFuture();
+        auto func = BindTask(std::forward<F>(f), std::forward<Args>(args)...);
+        Submit([promise = std::move(promise), func = std::move(func)]() mutable { promise.Run(func); });
+        return res;
+    }
+
+    // fire-and-forget, no future is created
+    template <typename F, typename... Args>
+    void Post(F&& f, Args&&... args) {
+        if (stop_) {
+            return;
+        }
+        Submit(BindTask(std::forward<F>(f), std::forward<Args>(args)...));
+    }
+
+    // never runs the task on the calling thread, return false and drop the task when the
+    // pool is stopped or saturated
+    template <typename F, typename... Args>
+    bool TryPost(F&& f, Args&&... args) {
+        if (stop_) {
+            return false;
+        }
+        return TrySubmit(BindTask(std::forward<F>(f), std::forward<Args>(args)...));
+    }
+
+    ~WorkStealingThreadPool() {
+        if (stop_.exchange(true)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_all();
+        }
+        for (std::thread& worker : workers_) {
+            worker.join();
+        }
+        // all workers have exited, drop the tasks which never ran
+        Task* task = nullptr;
+        for (auto& queue : local_queues_) {
+            while (queue->Pop(&task)) {
+                task_slots_.Release(task);
+            }
+        }
+        while (inject_queue_.Dequeue(&task)) {
+            task_slots_.Release(task);
+        }
     }
 
 private:
+    struct WorkerContext {
+        WorkStealingThreadPool* pool;
+        std::size_t index;
+    };
+
+    static WorkerContext& LocalWorker() {
+        static thread_local WorkerContext context = {nullptr, 0};
+        return context;
+    }
+
+    template <typename F>
+    void Submit(F&& func) {
+        // func is left untouched when no slot is free
+        if (hippo_unlikely(!TrySubmit(std::forward<F>(func)))) {
+            // pool is saturated, run on the caller thread
+            func();
+        }
+    }
+
+    template <typename F>
+    bool TrySubmit(F&& func) {
+        Task* task = task_slots_.Acquire();
+        if (hippo_unlikely(task == nullptr)) {
+            return false;
+        }
+        task->Emplace(std::forward<F>(func));
+        WorkerContext& local = LocalWorker();
+        if (local.pool == this) {
+            local_queues_[local.index]->Push(task);
+        } else {
+            EnqueueTaskSlot(&inject_queue_, task);
+        }
+        // pending_ must be published before idle_num_ is checked, pairs with Run()
+        pending_.fetch_add(1);
+        if (idle_num_.load() > 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_one();
+        }
+        return true;
+    }
+
+    bool TryGetTask(std::size_t index, Task** task) {
+        if (local_queues_[index]->Pop(task)) {
+            return true;
+        }
+        if (inject_queue_.Dequeue(task)) {
+            return true;
+        }
+        const std::size_t num = local_queues_.size();
+        for (std::size_t i = 1; i < num; ++i) {
+            if (local_queues_[(index + i) % num]->Steal(task)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Run(std::size_t index) {
+        LocalWorker() = {this, index};
+        Task* task = nullptr;
+        while (!stop_) {
+            if (TryGetTask(index, &task)) {
+                pending_.fetch_sub(1);
+                (*task)();
+                task_slots_.Release(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_num_.fetch_add(1);
+            cv_.wait(lock, [this] { return stop_ || pending_.load() > 0; });
+            idle_num_.fetch_sub(1);
+        }
+    }
+
     std::vector<std::thread> workers_;
-    BoundedQueue<std::function<void()>> task_queue_;
+    TaskSlotPool task_slots_;
+    std::vector<std::unique_ptr<WorkStealingDeque<Task*>>> local_queues_;
+    BoundedQueue<Task*> inject_queue_;
+    alignas(CACHELINE_SIZE) std::atomic<int64_t> pending_ = {0};
+    alignas(CACHELINE_SIZE) std::atomic<uint32_t> idle_num_ = {0};
+    std::mutex mutex_;
+    std::condition_variable cv_;
     std::atomic_bool stop_;
 };
 
+/**
+ * @brief One ThreadPool per NUMA node
+ *
+ * The workers of a sub-pool are pinned to the cpus of their node, and the task slots and
+ * queue of the sub-pool are allocated while the node is the preferred one, so a task is
+ * written, queued and run without leaving the node. Enqueue and Post submit to the node
+ * the calling thread runs on, EnqueueOnNode and PostOnNode to a given node. Like ThreadPool,
+ * a saturated sub-pool runs the task on the calling thread. Nodes without
+ * cpus get no sub-pool, their submissions go to the first node which has one.
+ */
+class NumaThreadPool {
+public:
+    explicit NumaThreadPool(std::size_t threads_per_node, std::size_t max_task_num = 1000,
+                            const NumaTopology& topology = NumaTopology::Instance())
+        : topology_(topology), pools_(topology.NodeNum()) {
+        for (int node = 0; node < topology_.NodeNum(); ++node) {
+            const std::vector<int>& cpus = topology_.CpusOfNode(node);
+            if (cpus.empty()) {
+                continue;
+            }
+            ScopedPreferredNode preferred(node);
+            pools_[node].reset(new ThreadPool(threads_per_node, max_task_num,
+                                              [cpus](std::size_t) { Numa::PinThreadToCpus(cpus); }));
+            if (default_node_ < 0) {
+                default_node_ = node;
+            }
+        }
+        if (default_node_ < 0) {
+            throw std::runtime_error("Numa topology has no cpu.");
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto Enqueue(F&& f, Args&&... args) -> TaskFuture<typename std::result_of<F(Args...)>::type> {
+        return Pool(topology_.CurrentNode()).Enqueue(std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    template <typename F, typename... Args>
+    auto EnqueueOnNode(int node, F&& f, Args&&... args) -> TaskFuture<typename std::result_of<F(Args...)>::type> {
+        return Pool(node).Enqueue(std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    // fire-and-forget, no future is created
+    template <typename F, typename... Args>
+    void Post(F&& f, Args&&... args) {
+        Pool(topology_.CurrentNode()).Post(std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    template <typename F, typename... Args>
+    void PostOnNode(int node, F&& f, Args&&... args) {
+        Pool(node).Post(std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    // see ThreadPool::TryPost
+    template <typename F, typename... Args>
+    bool TryPost(F&& f, Args&&... args) {
+        return Pool(topology_.CurrentNode()).TryPost(std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    const NumaTopology& Topology() const { return topology_; }
+
+private:
+    ThreadPool& Pool(int node) {
+        if (node < 0 || node >= static_cast<int>(pools_.size()) || pools_[node] == nullptr) {
+            node = default_node_;
+        }
+        return *pools_[node];
+    }
+
+    NumaTopology topology_;
+    std::vector<std::unique_ptr<ThreadPool>> pools_;
+    int default_node_ = -1;
+};
+
 NAMESPACE_COMMON_END
 NAMESPACE_HIPPO_END
 
@@ -8,29 +8,40 @@
 #define __HIPPO_THREAD_SAFE_QUEUE_HPP__
 
 #include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
 #include <utility>
 
 #include "hippo_namespace.hpp"
+#include "hippo_wati_strategy.hpp"
 
 NAMESPACE_HIPPO_BEGIN
 NAMESPACE_COMMON_BEGIN
 
-template <typename T>
+template <typename T, typename Allocator = std::allocator<T>>
 class ThreadSafeQueue {
 public:
+    using allocator_type = Allocator;
+
     ThreadSafeQueue() = default;
+    explicit ThreadSafeQueue(const Allocator& allocator) : queue_(std::deque<T, Allocator>(allocator)) {}
     ThreadSafeQueue& operator=(const ThreadSafeQueue& other) = delete;
     ThreadSafeQueue(const ThreadSafeQueue& other) = delete;
 
     ~ThreadSafeQueue() { BreakAllWait(); }
 
     void Enqueue(const T& element) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        queue_.emplace(element);
-        cv_.notify_one();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.emplace(element);
+            cv_.notify_one();
+        }
+        if (notifier_) {
+            notifier_->NotifyOne();
+        }
     }
 
     bool Dequeue(T* element) {
@@ -54,7 +65,7 @@ public:
         return true;
     }
 
-    typename std::queue<T>::size_type Size() {
+    typename std::deque<T, Allocator>::size_type Size() {
         std::lock_guard<std::mutex> lock(mutex_);
         return queue_.size();
     }
@@ -67,13 +78,21 @@ public:
     void BreakAllWait() {
         break_all_wait_ = true;
         cv_.notify_all();
+        if (notifier_) {
+            notifier_->BreakAllWait();
+        }
     }
 
+    // extra strategy notified on every Enqueue, e.g. an EventfdWaitStrategy polled by an event loop,
+    // WaitDequeue still blocks on the condition variable. Set it before the queue is shared.
+    void SetNotifier(WaitStrategy* strategy) { notifier_.reset(strategy); }
+
 private:
     volatile bool break_all_wait_ = false;
     std::mutex mutex_;
-    std::queue<T> queue_;
+    std::queue<T, std::deque<T, Allocator>> queue_;
     std::condition_variable cv_;
+    std::unique_ptr<WaitStrategy> notifier_ = nullptr;
 };
 
 NAMESPACE_COMMON_END
@@ -9,97 +9,267 @@
 
 #include <unistd.h>
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "hippo_namespace.hpp"
+#include "hippo_epoch_reclaimer.hpp"
+#include "hippo_macro.hpp"
 
 NAMESPACE_HIPPO_BEGIN
 NAMESPACE_COMMON_BEGIN
 
-template <typename T>
+#ifndef HIPPO_QUEUE_SEGMENT_SIZE
+#define HIPPO_QUEUE_SEGMENT_SIZE 1024
+#endif
+
+/**
+ * @brief Unbounded MPMC queue made of fixed size segments
+ *
+ * Producers claim a position with one fetch_add on tail_, consumers claim one with a
+ * cas on head_ which never passes tail_. A position maps to a slot of a segment, a new
+ * segment is linked when the last one is full. The consumer of the last slot of a segment
+ * retires it to the EpochDomain, and freed segments are recycled through a shared depot.
+ * A consumer which claimed a slot whose producer has not published yet spins on the slot.
+ *
+ * @tparam T Type of element, must be default constructible
+ * @tparam SegmentSize Slots per segment
+ * @tparam Allocator Allocator of the segments, only allocators which always compare equal share the
+ *         segment depot, the resource of any other one must outlive the segments retired to the EpochDomain
+ */
+template <typename T, std::size_t SegmentSize = HIPPO_QUEUE_SEGMENT_SIZE, typename Allocator = std::allocator<T>>
 class UnboundedQueue {
+    static_assert(SegmentSize >= 2, "SegmentSize must be at least 2");
+
 public:
+    using allocator_type = Allocator;
+
     UnboundedQueue() { Reset(); }
+    explicit UnboundedQueue(const Allocator& allocator) : allocator_(allocator) { Reset(); }
     UnboundedQueue& operator=(const UnboundedQueue& other) = delete;
     UnboundedQueue(const UnboundedQueue& other) = delete;
 
     ~UnboundedQueue() { Destroy(); }
 
+    // not thread safe
     void Clear() {
         Destroy();
         Reset();
     }
 
-    void Enqueue(const T& element) {
-        auto node = new Node();
-        node->data = element;
-        Node* old_tail = tail_.load();
+    void Enqueue(const T& element) { EnqueueImpl(element); }
+    void Enqueue(T&& element) { EnqueueImpl(std::move(element)); }
 
+    bool Dequeue(T* element) {
+        EpochGuard guard;
+        Segment* segment = nullptr;
+        uint64_t pos = head_.load(std::memory_order_relaxed);
         while (true) {
-            if (tail_.compare_exchange_strong(old_tail, node)) {
-                old_tail->next = node;
-                old_tail->release();
-                size_.fetch_add(1);
+            // load the segment before claiming, it can not move past the claimed position
+            segment = head_segment_.load(std::memory_order_acquire);
+            if (pos >= tail_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
                 break;
             }
         }
-    }
-
-    bool Dequeue(T* element) {
-        Node* old_head = head_.load();
-        Node* head_next = nullptr;
-        do {
-            head_next = old_head->next;
-
-            if (head_next == nullptr) {
-                return false;
+        segment = FindSegment(segment, pos);
+        AdvanceSegment(&head_segment_, segment);
+        Slot& slot = segment->slots[pos - segment->base];
+        // the producer has claimed this position, wait until it is published
+        for (uint32_t i = 0; slot.ready.load(std::memory_order_acquire) == 0; ++i) {
+            if (i < MAX_SPIN_TIMES) {
+                hippo_cpu_relax();
+            } else {
+                std::this_thread::yield();
             }
-        } while (!head_.compare_exchange_strong(old_head, head_next));
-        *element = head_next->data;
-        size_.fetch_sub(1);
-        old_head->release();
+        }
+        *element = std::move(slot.data);
+        if (segment->consumed_num.fetch_add(1, std::memory_order_acq_rel) + 1 == SegmentSize) {
+            RetireSegment(segment);
+        }
         return true;
     }
 
-    size_t Size() { return size_.load(); }
+    // approximate, derived from the cursors
+    size_t Size() {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
 
-    bool Empty() { return size_.load() == 0; }
+    bool Empty() { return Size() == 0; }
 
 private:
-    struct Node {
+    static const uint32_t MAX_SPIN_TIMES = 128;
+    static const std::size_t MAX_CACHED_SEGMENTS = 16;
+
+    struct Slot {
+        std::atomic<uint32_t> ready = {0};
         T data;
-        std::atomic<uint32_t> ref_count;
-        Node* next = nullptr;
-        Node() { ref_count.store(2); }
-        void release() {
-            ref_count.fetch_sub(1);
-            if (ref_count.load() == 0) {
-                delete this;
+    };
+
+    struct Segment;
+    using SegmentAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Segment>;
+    using SegmentTraits = std::allocator_traits<SegmentAllocator>;
+    // segments of another allocator would leak into this queue through the depot
+    static constexpr bool SHARED_DEPOT = SegmentTraits::is_always_equal::value;
+
+    struct Segment {
+        Segment(uint64_t base, const SegmentAllocator& allocator) : base(base), allocator(allocator) {}
+        uint64_t base;
+        std::atomic<Segment*> next = {nullptr};
+        // frees the segment once retired, the queue may be gone by then
+        SegmentAllocator allocator;
+        alignas(CACHELINE_SIZE) std::atomic<uint64_t> consumed_num = {0};
+        Slot slots[SegmentSize];
+    };
+
+    // free segments shared by all queues of the same type
+    struct SegmentDepot {
+        ~SegmentDepot() {
+            for (auto segment : segments) {
+                DeleteSegment(segment);
             }
         }
+        std::mutex mutex;
+        std::vector<Segment*> segments;
     };
 
+    static SegmentDepot& Depot() {
+        static SegmentDepot depot;
+        return depot;
+    }
+
+    Segment* NewSegment(uint64_t base) {
+        if (SHARED_DEPOT) {
+            auto& depot = Depot();
+            std::lock_guard<std::mutex> lock(depot.mutex);
+            if (!depot.segments.empty()) {
+                Segment* segment = depot.segments.back();
+                depot.segments.pop_back();
+                segment->base = base;
+                return segment;
+            }
+        }
+        Segment* segment = SegmentTraits::allocate(allocator_, 1);
+        return new (segment) Segment(base, allocator_);
+    }
+
+    static void DeleteSegment(Segment* segment) {
+        SegmentAllocator allocator(segment->allocator);
+        segment->~Segment();
+        SegmentTraits::deallocate(allocator, segment, 1);
+    }
+
+    // also the deleter of retired segments, runs once no reader can hold the segment
+    static void RecycleSegment(void* ptr) {
+        Segment* segment = static_cast<Segment*>(ptr);
+        if (!SHARED_DEPOT) {
+            DeleteSegment(segment);
+            return;
+        }
+        for (auto& slot : segment->slots) {
+            slot.ready.store(0, std::memory_order_relaxed);
+        }
+        segment->next.store(nullptr, std::memory_order_relaxed);
+        segment->consumed_num.store(0, std::memory_order_relaxed);
+        auto& depot = Depot();
+        {
+            std::lock_guard<std::mutex> lock(depot.mutex);
+            if (depot.segments.size() < MAX_CACHED_SEGMENTS) {
+                depot.segments.push_back(segment);
+                return;
+            }
+        }
+        DeleteSegment(segment);
+    }
+
+    template <typename U>
+    void EnqueueImpl(U&& element) {
+        EpochGuard guard;
+        // load the segment before claiming, it can not move past the claimed position
+        Segment* segment = tail_segment_.load(std::memory_order_acquire);
+        uint64_t pos = tail_.fetch_add(1, std::memory_order_acq_rel);
+        segment = FindSegment(segment, pos);
+        AdvanceSegment(&tail_segment_, segment);
+        Slot& slot = segment->slots[pos - segment->base];
+        slot.data = std::forward<U>(element);
+        slot.ready.store(1, std::memory_order_release);
+    }
+
+    // walk forward from segment to the one holding pos, linking new segments on the way
+    Segment* FindSegment(Segment* segment, uint64_t pos) {
+        while (pos >= segment->base + SegmentSize) {
+            Segment* next = segment->next.load(std::memory_order_acquire);
+            if (next == nullptr) {
+                Segment* new_segment = NewSegment(segment->base + SegmentSize);
+                if (segment->next.compare_exchange_strong(next, new_segment, std::memory_order_acq_rel,
+                                                          std::memory_order_acquire)) {
+                    next = new_segment;
+                } else {
+                    // never published
+                    RecycleSegment(new_segment);
+                }
+            }
+            segment = next;
+        }
+        return segment;
+    }
+
+    // move cursor forward to segment, never backward
+    void AdvanceSegment(std::atomic<Segment*>* cursor, Segment* segment) {
+        Segment* current = cursor->load(std::memory_order_acquire);
+        while (current->base < segment->base &&
+               !cursor->compare_exchange_weak(current, segment, std::memory_order_acq_rel,
+                                              std::memory_order_acquire)) {
+        }
+    }
+
+    // every slot of segment has been consumed
+    void RetireSegment(Segment* segment) {
+        // threads entering from now on must not reach segment through the cursors, while a
+        // cursor still points to it no later segment has been retired, so next is alive
+        for (auto cursor : {&head_segment_, &tail_segment_}) {
+            if (cursor->load(std::memory_order_acquire) == segment) {
+                AdvanceSegment(cursor, FindSegment(segment, segment->base + SegmentSize));
+            }
+        }
+        EpochDomain::Instance().Retire(segment, &RecycleSegment);
+    }
+
     void Reset() {
-        auto node = new Node();
-        head_.store(node);
-        tail_.store(node);
-        size_.store(0);
+        auto segment = NewSegment(0);
+        head_segment_.store(segment);
+        tail_segment_.store(segment);
+        head_.store(0);
+        tail_.store(0);
     }
 
+    // segments still retired in the EpochDomain belong to it, only the live chain is freed here
     void Destroy() {
-        auto ite = head_.load();
-        Node* tmp = nullptr;
+        Segment* ite = head_segment_.load();
+        Segment* tmp = nullptr;
         while (ite != nullptr) {
-            tmp = ite->next;
-            delete ite;
+            tmp = ite->next.load(std::memory_order_relaxed);
+            DeleteSegment(ite);
             ite = tmp;
         }
     }
 
-    std::atomic<Node*> head_;
-    std::atomic<Node*> tail_;
-    std::atomic<size_t> size_;
+    SegmentAllocator allocator_;
+    // producer side
+    alignas(CACHELINE_SIZE) std::atomic<uint64_t> tail_;
+    std::atomic<Segment*> tail_segment_;
+    // consumer side
+    alignas(CACHELINE_SIZE) std::atomic<uint64_t> head_;
+    std::atomic<Segment*> head_segment_;
 };
 
 NAMESPACE_COMMON_END
@@ -7,13 +7,24 @@
 #ifndef __HIPPO_WAIT_STRATEGY_HPP__
 #define __HIPPO_WAIT_STRATEGY_HPP__
 
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
 #include <chrono>
+#include <cerrno>
+#include <climits>
 #include <condition_variable>
+#include <cstdint>
 #include <cstdlib>
 #include <mutex>
 #include <thread>
 
 #include "hippo_namespace.hpp"
+#include "hippo_macro.hpp"
 
 NAMESPACE_HIPPO_BEGIN
 NAMESPACE_COMMON_BEGIN
@@ -24,6 +35,13 @@ public:
     virtual void BreakAllWait() {}
     virtual bool EmptyWait() = 0;
     virtual ~WaitStrategy() {}
+
+    // Two phase wait for strategies that park threads: take a key with PrepareWait, check the
+    // queue once more, then either CancelWait or EmptyWait(key). A notify after PrepareWait is
+    // never lost. Strategies that do not park keep the defaults.
+    virtual uint64_t PrepareWait() { return 0; }
+    virtual void CancelWait() {}
+    virtual bool EmptyWait(uint64_t /* key */) { return EmptyWait(); }
 };
 
 class BlockWaitStrategy : public WaitStrategy {
@@ -100,6 +118,189 @@ private:
     std::chrono::milliseconds time_out_;
 };
 
+/**
+ * @brief Spin with pause, then yield, then park on a futex
+ *
+ * NotifyOne is a fence and a load while nobody waits, it bumps the epoch only when a
+ * waiter is registered, and it only makes a syscall when a waiter is parked in the kernel.
+ */
+class AdaptiveWaitStrategy : public WaitStrategy {
+public:
+    AdaptiveWaitStrategy() {}
+    AdaptiveWaitStrategy(uint32_t spin_num, uint32_t yield_num) : spin_num_(spin_num), yield_num_(yield_num) {}
+
+    void NotifyOne() override {
+        // pairs with the fetch_add in PrepareWait, the enqueued element or waiter_num_ is seen
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (hippo_likely(waiter_num_.load(std::memory_order_relaxed) == 0)) {
+            return;
+        }
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        if (sleeper_num_.load(std::memory_order_seq_cst) > 0) {
+            FutexWake(1);
+        }
+    }
+
+    void BreakAllWait() override {
+        break_all_wait_.store(true);
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        FutexWake(INT_MAX);
+    }
+
+    uint64_t PrepareWait() override {
+        waiter_num_.fetch_add(1, std::memory_order_seq_cst);
+        return epoch_.load(std::memory_order_acquire);
+    }
+
+    void CancelWait() override { waiter_num_.fetch_sub(1, std::memory_order_release); }
+
+    bool EmptyWait(uint64_t key) override {
+        const uint32_t epoch = static_cast<uint32_t>(key);
+        if (!SpinUntilChanged(epoch)) {
+            sleeper_num_.fetch_add(1, std::memory_order_seq_cst);
+            while (epoch_.load(std::memory_order_acquire) == epoch && !break_all_wait_.load()) {
+                // returns at once if epoch_ has changed already
+                FutexWait(epoch);
+            }
+            sleeper_num_.fetch_sub(1, std::memory_order_release);
+        }
+        waiter_num_.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    // without a key a notify may be lost, so never park
+    bool EmptyWait() override {
+        SpinUntilChanged(epoch_.load(std::memory_order_acquire));
+        std::this_thread::yield();
+        return true;
+    }
+
+    void SetSpinNum(uint32_t spin_num) { spin_num_ = spin_num; }
+    void SetYieldNum(uint32_t yield_num) { yield_num_ = yield_num; }
+
+private:
+    // return true if epoch_ moved away from epoch before running out of spins and yields
+    bool SpinUntilChanged(uint32_t epoch) {
+        for (uint32_t i = 0; i < spin_num_; ++i) {
+            if (epoch_.load(std::memory_order_acquire) != epoch) {
+                return true;
+            }
+            hippo_cpu_relax();
+        }
+        for (uint32_t i = 0; i < yield_num_; ++i) {
+            if (epoch_.load(std::memory_order_acquire) != epoch) {
+                return true;
+            }
+            std::this_thread::yield();
+        }
+        return epoch_.load(std::memory_order_acquire) != epoch;
+    }
+
+    void FutexWait(uint32_t epoch) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAIT_PRIVATE, epoch, nullptr, nullptr, 0);
+    }
+
+    void FutexWake(int num) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE, num, nullptr, nullptr, 0);
+    }
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+
+    alignas(CACHELINE_SIZE) std::atomic<uint32_t> epoch_ = {0};
+    std::atomic<uint32_t> waiter_num_ = {0};
+    std::atomic<uint32_t> sleeper_num_ = {0};
+    std::atomic<bool> break_all_wait_ = {false};
+    uint32_t spin_num_ = 128;
+    uint32_t yield_num_ = 8;
+};
+
+/**
+ * @brief Wait strategy backed by an eventfd, so a queue can be polled by an epoll loop
+ *
+ * Register Fd() with EPOLLIN. When it becomes readable call Consume(), then Dequeue until
+ * the queue is empty. Notifications are coalesced: only the first NotifyOne after a
+ * Consume() writes the eventfd, the following ones are a single atomic exchange.
+ * Threads that are not in an event loop may still block in WaitDequeue, they poll the fd.
+ */
+class EventfdWaitStrategy : public WaitStrategy {
+public:
+    EventfdWaitStrategy() : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+    explicit EventfdWaitStrategy(int timeout_ms) : EventfdWaitStrategy() { timeout_ms_ = timeout_ms; }
+    EventfdWaitStrategy(const EventfdWaitStrategy& other) = delete;
+    EventfdWaitStrategy& operator=(const EventfdWaitStrategy& other) = delete;
+    ~EventfdWaitStrategy() override {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    void NotifyOne() override {
+        // the enqueued element must be visible before signaled_ is read, pairs with the fence
+        // in Consume(): either the consumer drains the element or we see signaled_ cleared
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // cheap check first, the exchange releases the enqueued element to Consume()
+        if (signaled_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        if (!signaled_.exchange(true, std::memory_order_acq_rel)) {
+            Signal();
+        }
+    }
+
+    void BreakAllWait() override {
+        break_all_wait_.store(true);
+        Signal();
+    }
+
+    bool EmptyWait() override {
+        if (break_all_wait_.load()) {
+            return true;
+        }
+        if (hippo_unlikely(fd_ < 0)) {
+            std::this_thread::yield();
+            return true;
+        }
+        struct pollfd pfd = {fd_, POLLIN, 0};
+        int ret = poll(&pfd, 1, timeout_ms_);
+        if (ret == 0) {
+            // wait timeout
+            return false;
+        }
+        if (ret > 0 && !break_all_wait_.load()) {
+            Consume();
+        }
+        return true;
+    }
+
+    // -1 if the eventfd could not be created
+    int Fd() const { return fd_; }
+
+    // rearm the notification, call it before draining the queue
+    void Consume() {
+        signaled_.exchange(false, std::memory_order_acq_rel);
+        // the cleared flag must be visible before the queue is drained, pairs with NotifyOne()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t value = 0;
+        while (read(fd_, &value, sizeof(value)) < 0 && errno == EINTR) {
+        }
+    }
+
+    // timeout of a blocking EmptyWait in milliseconds, -1 waits forever
+    void SetTimeout(int timeout_ms) { timeout_ms_ = timeout_ms; }
+
+private:
+    void Signal() {
+        uint64_t value = 1;
+        while (write(fd_, &value, sizeof(value)) < 0 && errno == EINTR) {
+        }
+    }
+
+    const int fd_;
+    int timeout_ms_ = -1;
+    alignas(CACHELINE_SIZE) std::atomic<bool> signaled_ = {false};
+    std::atomic<bool> break_all_wait_ = {false};
+};
+
 NAMESPACE_COMMON_END
 NAMESPACE_HIPPO_END
 
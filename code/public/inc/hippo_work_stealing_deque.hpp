@@ -0,0 +1,143 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_WORK_STEALING_DEQUE_HPP__
+#define __HIPPO_WORK_STEALING_DEQUE_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "hippo_namespace.hpp"
+#include "hippo_macro.hpp"
+
+NAMESPACE_HIPPO_BEGIN
+NAMESPACE_COMMON_BEGIN
+
+/**
+ * @brief Chase-Lev work stealing deque (Le, Pop, Cohen, Nardelli, PPoPP'13)
+ *
+ * Only the owner thread may call Push/Pop, they work on the bottom end.
+ * Any thread may call Steal, which takes from the top end.
+ *
+ * @tparam T Type of element, must be trivially copyable (usually a pointer)
+ */
+template <typename T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+public:
+    explicit WorkStealingDeque(uint64_t capacity = 1024) {
+        uint64_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        array_.store(new Array(size), std::memory_order_relaxed);
+    }
+    WorkStealingDeque(const WorkStealingDeque& other) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque& other) = delete;
+    ~WorkStealingDeque() {
+        for (auto array : garbage_) {
+            delete array;
+        }
+        delete array_.load(std::memory_order_relaxed);
+    }
+
+    // owner only
+    void Push(T item) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        Array* array = array_.load(std::memory_order_relaxed);
+        if (hippo_unlikely(bottom - top > static_cast<int64_t>(array->capacity) - 1)) {
+            array = Grow(array, top, bottom);
+        }
+        array->Put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // owner only
+    bool Pop(T* item) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* array = array_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            // empty
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        *item = array->Get(bottom);
+        if (top == bottom) {
+            // last element, race with thieves
+            bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // any thread, may fail spuriously when racing with other thieves
+    bool Steal(T* item) {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return false;
+        }
+        Array* array = array_.load(std::memory_order_acquire);
+        T tmp = array->Get(top);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return false;
+        }
+        *item = tmp;
+        return true;
+    }
+
+    uint64_t Size() {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        return bottom > top ? static_cast<uint64_t>(bottom - top) : 0;
+    }
+    bool Empty() { return Size() == 0; }
+
+private:
+    struct Array {
+        explicit Array(uint64_t size) : capacity(size), mask(size - 1), buffer(new std::atomic<T>[size]) {}
+        ~Array() { delete[] buffer; }
+
+        T Get(int64_t index) { return buffer[index & mask].load(std::memory_order_relaxed); }
+        void Put(int64_t index, T item) { buffer[index & mask].store(item, std::memory_order_relaxed); }
+
+        uint64_t capacity;
+        uint64_t mask;
+        std::atomic<T>* buffer;
+    };
+
+    Array* Grow(Array* old_array, int64_t top, int64_t bottom) {
+        Array* new_array = new Array(old_array->capacity << 1);
+        for (int64_t i = top; i != bottom; ++i) {
+            new_array->Put(i, old_array->Get(i));
+        }
+        // thieves may still read the old array, keep it until destruction
+        garbage_.push_back(old_array);
+        array_.store(new_array, std::memory_order_release);
+        return new_array;
+    }
+
+    alignas(CACHELINE_SIZE) std::atomic<int64_t> top_ = {0};
+    alignas(CACHELINE_SIZE) std::atomic<int64_t> bottom_ = {0};
+    alignas(CACHELINE_SIZE) std::atomic<Array*> array_ = {nullptr};
+    std::vector<Array*> garbage_;
+};
+
+NAMESPACE_COMMON_END
+NAMESPACE_HIPPO_END
+
+#endif  // !__HIPPO_WORK_STEALING_DEQUE_HPP__
@@ -0,0 +1,138 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// InplaceFunction and FunctionRef, including the callers which store value returning callables
+// behind a void signature: thread pool tasks and signal slots
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "hippo_function.hpp"
+#include "hippo_signal.hpp"
+#include "hippo_thread_pool.hpp"
+#include "hippo_test.hpp"
+
+using Hippo::Common::FunctionRef;
+using Hippo::Common::InplaceFunction;
+using Hippo::Common::Signal;
+using Hippo::Common::ThreadPool;
+using Hippo::Common::WorkStealingThreadPool;
+
+static std::atomic<int> called_num(0);
+
+static int Twice(int x) {
+    called_num.fetch_add(1);
+    return 2 * x;
+}
+
+static void WaitCalled(int num) {
+    while (called_num.load() < num) {
+        std::this_thread::yield();
+    }
+}
+
+static void TestInplaceFunction() {
+    InplaceFunction<int(int)> twice(Twice);
+    CHECK(twice(3) == 6);
+
+    // too large for the inline buffer, lives on the heap
+    std::array<int, 64> big{};
+    big[0] = 5;
+    InplaceFunction<int(int)> heap([big](int x) { return big[0] + x; });
+    CHECK(heap(1) == 6);
+
+    InplaceFunction<void(int)> dropped(Twice);
+    called_num.store(0);
+    dropped(1);
+    InplaceFunction<void()> heap_dropped([big] { return big[0]; });
+    heap_dropped();
+    CHECK(called_num.load() == 1);
+
+    InplaceFunction<int(int)> moved(std::move(heap));
+    CHECK(!heap);
+    CHECK(moved(2) == 7);
+
+    InplaceFunction<void()> empty;
+    bool thrown = false;
+    try {
+        empty();
+    } catch (const std::bad_function_call &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    InplaceFunction<void()> null_pointer(static_cast<void (*)()>(nullptr));
+    CHECK(!null_pointer);
+}
+
+static void TestFunctionRef() {
+    int base = 10;
+    auto add = [&base](int x) { return base + x; };
+    FunctionRef<int(int)> lambda_ref(add);
+    CHECK(lambda_ref(1) == 11);
+
+    FunctionRef<int(int)> function_ref(Twice);
+    CHECK(function_ref(4) == 8);
+    FunctionRef<int(int)> pointer_ref(&Twice);
+    CHECK(pointer_ref(5) == 10);
+
+    called_num.store(0);
+    FunctionRef<void(int)> dropped(Twice);
+    dropped(1);
+    CHECK(called_num.load() == 1);
+}
+
+static void TestPools() {
+    called_num.store(0);
+    {
+        ThreadPool pool(2);
+        pool.Post([] { return called_num.fetch_add(1); });
+        pool.Post(Twice, 3);
+        CHECK(pool.TryPost(Twice, 4));
+        WaitCalled(3);
+
+        WorkStealingThreadPool stealing_pool(2);
+        stealing_pool.Post([] { return called_num.fetch_add(1); });
+        stealing_pool.Post(Twice, 3);
+        WaitCalled(5);
+    }
+    CHECK(called_num.load() == 5);
+}
+
+static void TestSignal() {
+    Signal<int> signal;
+    std::atomic<int> positive_num(0);
+    auto direct = signal.Connect([&positive_num](int x) {
+        positive_num.fetch_add(x > 0 ? 1 : 0);
+        return x > 0;
+    });
+    auto function = signal.Connect(Twice);
+
+    called_num.store(0);
+    signal(1);
+    signal(-1);
+    CHECK(positive_num.load() == 1);
+    CHECK(called_num.load() == 2);
+    direct.Disconnect();
+    function.Disconnect();
+
+    ThreadPool pool(1);
+    auto async = signal.Connect(Twice, pool);
+    called_num.store(0);
+    signal(2);
+    WaitCalled(1);
+    async.Disconnect();
+}
+
+int main() {
+    TestInplaceFunction();
+    TestFunctionRef();
+    TestPools();
+    TestSignal();
+
+    return HippoTest::Report();
+}
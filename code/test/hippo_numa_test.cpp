@@ -0,0 +1,148 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// NUMA support against a fake sysfs node tree, so it runs the same on a single node machine:
+//   node0 cpus 0-1,4, node1 absent, node2 cpus 2-3, node3 memory only
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "hippo_numa.hpp"
+#include "hippo_object_poll.hpp"
+#include "hippo_thread_pool.hpp"
+#include "hippo_test.hpp"
+
+using Hippo::Common::Numa;
+using Hippo::Common::NumaResource;
+using Hippo::Common::NumaThreadPool;
+using Hippo::Common::NumaTopology;
+using Hippo::Common::ObjectPool;
+using Hippo::Common::ScopedPreferredNode;
+
+static void WriteNode(const std::string &dir, const std::string &node, const std::string &cpu_list) {
+    const std::string node_dir = dir + "/" + node;
+    mkdir(node_dir.c_str(), 0755);
+    std::ofstream(node_dir + "/cpulist") << cpu_list << "\n";
+}
+
+static std::string MakeFakeTree() {
+    char dir[] = "/tmp/hippo_numa_test_XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        return "";
+    }
+    WriteNode(dir, "node0", "0-1,4");
+    WriteNode(dir, "node2", "2-3");
+    WriteNode(dir, "node3", "");
+    // not nodes, must be skipped
+    WriteNode(dir, "node5x", "7");
+    WriteNode(dir, "power", "8");
+    return dir;
+}
+
+static void RemoveFakeTree(const std::string &dir) {
+    for (const char *node : {"node0", "node2", "node3", "node5x", "power"}) {
+        unlink((dir + "/" + node + "/cpulist").c_str());
+        rmdir((dir + "/" + node).c_str());
+    }
+    rmdir(dir.c_str());
+}
+
+static void TestParseCpuList() {
+    CHECK((NumaTopology::ParseCpuList("0-3,8,10-11") == std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    CHECK((NumaTopology::ParseCpuList("5") == std::vector<int>{5}));
+    CHECK((NumaTopology::ParseCpuList("64-65,2") == std::vector<int>{64, 65, 2}));
+    CHECK(NumaTopology::ParseCpuList("").empty());
+    CHECK(NumaTopology::ParseCpuList(",").empty());
+}
+
+static void TestDetect(const NumaTopology &topology) {
+    CHECK(topology.NodeNum() == 4);
+    CHECK((topology.CpusOfNode(0) == std::vector<int>{0, 1, 4}));
+    CHECK(topology.CpusOfNode(1).empty());
+    CHECK((topology.CpusOfNode(2) == std::vector<int>{2, 3}));
+    CHECK(topology.CpusOfNode(3).empty());
+    CHECK(topology.CpusOfNode(-1).empty());
+    CHECK(topology.CpusOfNode(4).empty());
+    CHECK(topology.NodeOfCpu(4) == 0);
+    CHECK(topology.NodeOfCpu(3) == 2);
+    CHECK(topology.NodeOfCpu(5) == -1);
+    CHECK(topology.NodeOfCpu(-1) == -1);
+
+    // a missing tree is a single node holding every cpu
+    NumaTopology single = NumaTopology::Detect("/nonexistent/hippo/node");
+    CHECK(single.NodeNum() == 1);
+    CHECK(!single.CpusOfNode(0).empty());
+}
+
+static void TestPoolFallback(const NumaTopology &topology) {
+    NumaThreadPool pool(1, 16, topology);
+    // nodes without a sub-pool and unknown nodes go to node 0
+    for (int node : {0, 1, 2, 3, -1, 99}) {
+        auto future = pool.EnqueueOnNode(node, [](int value) { return value * 2; }, node);
+        CHECK(future.get() == node * 2);
+    }
+    std::atomic<int> ran(0);
+    pool.PostOnNode(3, [&ran] { ++ran; });
+    pool.Post([&ran] { ++ran; });
+    CHECK(pool.Enqueue([] { return 1; }).get() == 1);
+    while (ran.load() < 2) {
+        std::this_thread::yield();
+    }
+    CHECK(pool.Topology().NodeNum() == 4);
+}
+
+static void TestSilentDegrade(const NumaTopology &topology) {
+    // no cpu or a node the kernel rejects, nothing changes and the callers go on
+    CHECK(!Numa::PinThreadToNode(3, topology));
+    CHECK(!Numa::PinThreadToNode(1, topology));
+    CHECK(!Numa::PinThreadToCpus({}));
+    CHECK(!Numa::SetPreferredNode(100000));
+    {
+        ScopedPreferredNode preferred(100000);
+    }
+
+    NumaResource resource(100000);
+    void *ptr = resource.allocate(3 * 4096 + 1);
+    CHECK(ptr != nullptr);
+    static_cast<char *>(ptr)[3 * 4096] = 1;
+    CHECK(!Numa::BindMemory(ptr, 4096, 100000));
+    resource.deallocate(ptr, 3 * 4096 + 1);
+
+    ObjectPool<int>::Options options;
+    options.chunk_objects = 64;
+    options.max_objects = 64;
+    options.numa_node = 100000;
+    auto pool = std::make_shared<ObjectPool<int>>(options);
+    auto object = pool->GetUnique();
+    CHECK(object != nullptr);
+    if (object != nullptr) {
+        *object = 7;
+        CHECK(*object == 7);
+    }
+}
+
+int main() {
+    const std::string dir = MakeFakeTree();
+    if (dir.empty()) {
+        fprintf(stderr, "cannot create the fake node tree\n");
+        return 1;
+    }
+    NumaTopology topology = NumaTopology::Detect(dir);
+    RemoveFakeTree(dir);
+
+    TestParseCpuList();
+    TestDetect(topology);
+    TestPoolFallback(topology);
+    TestSilentDegrade(topology);
+    return HippoTest::Report();
+}
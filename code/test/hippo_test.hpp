@@ -0,0 +1,43 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+#ifndef __HIPPO_TEST_HPP__
+#define __HIPPO_TEST_HPP__
+
+#include <atomic>
+#include <cstdio>
+
+// Checks shared by the tests, kept out of code/public/inc on purpose
+
+namespace HippoTest {
+
+inline std::atomic<int> &FailedNum() {
+    static std::atomic<int> failed_num(0);
+    return failed_num;
+}
+
+// exit code of main
+inline int Report() {
+    if (FailedNum().load() != 0) {
+        fprintf(stderr, "%d checks failed\n", FailedNum().load());
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
+
+}  // namespace HippoTest
+
+// usable from any thread
+#define CHECK(cond)                                                    \
+    do {                                                               \
+        if (!(cond)) {                                                 \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            HippoTest::FailedNum().fetch_add(1);                       \
+        }                                                              \
+    } while (0)
+
+#endif  // !__HIPPO_TEST_HPP__
@@ -0,0 +1,191 @@
+/*
+ * Copyright(C): Hippo code, All Rights Reserved
+ *
+ * Author: Hippo(yinyanxx1028@gmail.com)
+ */
+
+// MPMC stress of UnboundedQueue and the epoch reclamation behind it, meant to be run under
+// -DHIPPO_SANITIZER=address and thread as well. Small segment sizes retire a segment every
+// few elements, so Retire, Reclaim and the segment depot all run hot.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hippo_epoch_reclaimer.hpp"
+#include "hippo_unbounded_queue.hpp"
+#include "hippo_test.hpp"
+
+using Hippo::Common::EpochDomain;
+using Hippo::Common::EpochGuard;
+using Hippo::Common::UnboundedQueue;
+
+static const int PRODUCER_NUM = 4;
+static const int CONSUMER_NUM = 4;
+static const uint64_t ELEMENT_NUM = 50000;
+
+// producer id in the high half, sequence in the low half
+static uint64_t Encode(int producer, uint64_t seq) { return (static_cast<uint64_t>(producer) << 32) | seq; }
+
+// owning elements, a segment freed too early or an element leaked shows up under ASan
+template <std::size_t SegmentSize>
+static void StressMpmc() {
+    UnboundedQueue<std::unique_ptr<uint64_t>, SegmentSize> queue;
+    std::atomic<uint64_t> consumed_num(0);
+    std::atomic<uint64_t> consumed_sum(0);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < PRODUCER_NUM; ++p) {
+        threads.emplace_back([&queue, p] {
+            for (uint64_t seq = 0; seq < ELEMENT_NUM; ++seq) {
+                queue.Enqueue(std::unique_ptr<uint64_t>(new uint64_t(Encode(p, seq))));
+            }
+        });
+    }
+    for (int c = 0; c < CONSUMER_NUM; ++c) {
+        threads.emplace_back([&] {
+            // elements of one producer must come out in order for every consumer
+            std::vector<int64_t> last_seq(PRODUCER_NUM, -1);
+            uint64_t sum = 0;
+            std::unique_ptr<uint64_t> element;
+            while (consumed_num.load(std::memory_order_relaxed) < PRODUCER_NUM * ELEMENT_NUM) {
+                if (!queue.Dequeue(&element)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                const int producer = static_cast<int>(*element >> 32);
+                const int64_t seq = static_cast<int64_t>(*element & 0xFFFFFFFFu);
+                CHECK(producer >= 0 && producer < PRODUCER_NUM);
+                if (producer >= 0 && producer < PRODUCER_NUM) {
+                    CHECK(seq > last_seq[producer]);
+                    last_seq[producer] = seq;
+                }
+                sum += static_cast<uint64_t>(seq);
+                consumed_num.fetch_add(1, std::memory_order_relaxed);
+            }
+            consumed_sum.fetch_add(sum);
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    CHECK(consumed_num.load() == PRODUCER_NUM * ELEMENT_NUM);
+    CHECK(consumed_sum.load() == PRODUCER_NUM * (ELEMENT_NUM * (ELEMENT_NUM - 1) / 2));
+    CHECK(queue.Empty());
+    CHECK(queue.Size() == 0);
+    std::unique_ptr<uint64_t> element;
+    CHECK(!queue.Dequeue(&element));
+}
+
+// elements left behind are released by the destructor, spanning several segments
+template <std::size_t SegmentSize>
+static void DestroyNonEmpty() {
+    UnboundedQueue<std::unique_ptr<uint64_t>, SegmentSize> queue;
+    for (uint64_t i = 0; i < 10 * SegmentSize + 1; ++i) {
+        queue.Enqueue(std::unique_ptr<uint64_t>(new uint64_t(i)));
+    }
+    std::unique_ptr<uint64_t> element;
+    for (uint64_t i = 0; i < 3 * SegmentSize; ++i) {
+        CHECK(queue.Dequeue(&element) && *element == i);
+    }
+    CHECK(queue.Size() == 7 * SegmentSize + 1);
+}
+
+static std::atomic<int> deleted_num(0);
+
+static void CountingDeleter(void *ptr) {
+    delete static_cast<uint64_t *>(ptr);
+    deleted_num.fetch_add(1);
+}
+
+// a guard taken before the retire holds the deleter back until it is dropped
+static void GuardBlocksReclaim() {
+    EpochDomain &domain = EpochDomain::Instance();
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool pinned = false;
+    bool release = false;
+
+    std::thread reader([&] {
+        EpochGuard guard;
+        std::unique_lock<std::mutex> lock(mutex);
+        pinned = true;
+        cond.notify_all();
+        cond.wait(lock, [&] { return release; });
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&] { return pinned; });
+    }
+
+    deleted_num.store(0);
+    domain.Retire(new uint64_t(1), CountingDeleter);
+    for (int i = 0; i < 16; ++i) {
+        domain.Reclaim();
+    }
+    CHECK(deleted_num.load() == 0);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+        cond.notify_all();
+    }
+    reader.join();
+    for (int i = 0; i < 16 && deleted_num.load() == 0; ++i) {
+        domain.Reclaim();
+    }
+    CHECK(deleted_num.load() == 1);
+}
+
+// readers dereference a pointer the writer keeps swapping and retiring, any early free is a use after free
+static void ReadersAgainstRetire() {
+    static const uint64_t MAGIC = 0x5A5A5A5A5A5A5A5Au;
+    static const int SWAP_NUM = 20000;
+    EpochDomain &domain = EpochDomain::Instance();
+    std::atomic<uint64_t *> shared(new uint64_t(MAGIC));
+    std::atomic<bool> stop(false);
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&] {
+            while (!stop.load(std::memory_order_relaxed)) {
+                EpochGuard guard;
+                const uint64_t *value = shared.load(std::memory_order_acquire);
+                CHECK(*value == MAGIC);
+            }
+        });
+    }
+    for (int i = 0; i < SWAP_NUM; ++i) {
+        uint64_t *old = shared.exchange(new uint64_t(MAGIC), std::memory_order_acq_rel);
+        domain.Retire(old);
+        if (i % 1024 == 0) {
+            std::this_thread::yield();
+        }
+    }
+    stop.store(true);
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    delete shared.load();
+    for (int i = 0; i < 16; ++i) {
+        domain.Reclaim();
+    }
+}
+
+int main() {
+    GuardBlocksReclaim();
+    ReadersAgainstRetire();
+
+    StressMpmc<2>();
+    StressMpmc<4>();
+    StressMpmc<HIPPO_QUEUE_SEGMENT_SIZE>();
+    DestroyNonEmpty<2>();
+    DestroyNonEmpty<HIPPO_QUEUE_SEGMENT_SIZE>();
+
+    return HippoTest::Report();
+}